@@ -0,0 +1,282 @@
+/*************************************************************************
+ * Throughput and latency benchmark for the xChaCha library.             *
+ * Results are printed as JSON so runs on different builds and CPUs can  *
+ * be compared side by side:  ./bench [max_bytes] > bench_output.txt     *
+ *************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "./src/xchacha.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define CYCLES() __rdtsc()              /* TSC reference cycles */
+#define HAVE_CYCLES 1
+#else
+#define CYCLES() 0
+#define HAVE_CYCLES 0
+#endif
+
+#define MIN_NS 50000000.0               /* time each measurement >= 50 ms */
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+typedef struct {
+    double ns;                          /* per iteration */
+    double cycles;                      /* per iteration */
+    uint64_t iterations;
+} sample;
+
+typedef void (*bench_fn)(void *arg);
+
+/** Run fn until at least MIN_NS has elapsed, doubling the batch each time */
+static sample measure(bench_fn fn, void *arg){
+    sample s;
+    uint64_t n = 1, i;
+    for (;;) {
+        double t0 = now_ns();
+        uint64_t c0 = CYCLES();
+        for (i = 0; i < n; i++) fn(arg);
+        uint64_t c1 = CYCLES();
+        double t1 = now_ns();
+        if ((t1 - t0) >= MIN_NS) {
+            s.ns = (t1 - t0) / n;
+            s.cycles = (double)(c1 - c0) / n;
+            s.iterations = n;
+            return s;
+        }
+        n *= 2;
+    }
+}
+
+static uint8_t key[32], iv[24];
+static uint8_t *buf;
+static xChaCha_ctx ctx;
+static size_t size;
+
+static void run_encrypt(void *arg){
+    (void)arg;
+    xchacha_encrypt_bytes(&ctx, buf, buf, (uint32_t)size);
+}
+
+static void run_init(void *arg){
+    (void)arg;
+    xchacha_init(&ctx, key, iv);
+}
+
+static xchacha_subkey_cache cache;
+static xchacha_key_handle handle;
+static xChaCha_ctx ctxs[16];
+static uint8_t ivs[16 * 24];
+
+static void run_init_cached(void *arg){
+    (void)arg;
+    xchacha_init_cached(&cache, &handle, &ctx, iv);
+}
+
+static void run_init_multi(void *arg){
+    (void)arg;
+    xchacha_init_multi(ctxs, key, ivs, 16);
+}
+
+#define BATCH 16
+static xchacha_msg msgs[BATCH];
+
+static void run_batch(void *arg){
+    (void)arg;
+    xchacha_encrypt_batch(msgs, BATCH);
+}
+
+static void run_batch_loop(void *arg){
+    (void)arg;
+    for (int i = 0; i < BATCH; i++) {
+        xchacha_init(&ctx, msgs[i].key, msgs[i].nonce);
+        xchacha_encrypt(&ctx, msgs[i].in, msgs[i].out, msgs[i].len);
+    }
+}
+
+static void run_crypt_init(void *arg){
+    (void)arg;
+    xc_crypt_init(&ctx, key, iv);
+}
+
+static void run_crypt_block(void *arg){
+    (void)arg;
+    for (size_t i = 0; i < size; i += 16) {
+        xc_crypt_block(&ctx, &buf[i], &buf[i], 0);
+    }
+}
+
+static void run_crypt_blocks(void *arg){
+    (void)arg;
+    xc_crypt_blocks(&ctx, buf, buf, size / 16, 0);
+}
+
+static void run_random_u32(void *arg){
+    (void)arg;
+    for (size_t i = 0; i < 1000; i++) *(volatile uint32_t *)buf = xchacha_random_u32();
+}
+
+static void run_random_bytes(void *arg){
+    (void)arg;
+    xchacha_random_bytes(buf, size);
+}
+
+static uint8_t *dst;
+static uint32_t crc;
+
+static void run_separate_crc(void *arg){
+    (void)arg;
+    xchacha_encrypt(&ctx, buf, dst, size);
+    crc = xc_crc32c(0, dst, size);
+}
+
+static void run_fused_crc(void *arg){
+    (void)arg;
+    crc = xchacha_encrypt_crc32c(&ctx, buf, dst, size, 0);
+}
+
+#define SIP_KEYS 1024                   /* 16-byte hash table keys */
+static const uint8_t *sip_msg[SIP_KEYS];
+static size_t sip_len[SIP_KEYS];
+static uint64_t sip_out[SIP_KEYS];
+
+static void run_siphash(void *arg){
+    (void)arg;
+    for (size_t i = 0; i < SIP_KEYS; i++) sip_out[i] = xc_siphash(key, sip_msg[i], sip_len[i]);
+}
+
+static void run_siphash_batch(void *arg){
+    (void)arg;
+    xc_siphash_batch(key, sip_msg, sip_len, sip_out, SIP_KEYS);
+}
+
+static void print_rate(const char *indent, sample s, double bytes){
+    printf("%s\"iterations\": %llu, \"bytes_per_sec\": %.0f, ",
+           indent, (unsigned long long)s.iterations, bytes * 1e9 / s.ns);
+    if (HAVE_CYCLES) printf("\"cycles_per_byte\": %.3f", s.cycles / bytes);
+    else printf("\"cycles_per_byte\": null");
+}
+
+static void print_latency(const char *name, sample s){
+    printf("  \"%s\": {\"iterations\": %llu, \"ns_per_call\": %.1f, ",
+           name, (unsigned long long)s.iterations, s.ns);
+    if (HAVE_CYCLES) printf("\"cycles_per_call\": %.1f},\n", s.cycles);
+    else printf("\"cycles_per_call\": null},\n");
+}
+
+int main(int argc, char *argv[]){
+    size_t max = 64u << 20;
+    int id, best = xchacha_kernel(), first = 1;
+
+    if (argc > 1) max = (size_t)strtoull(argv[1], 0, 0);
+    if (max < 16) max = 16;
+    if (((buf = calloc(max, 1)) == NULL) || ((dst = calloc(max, 1)) == NULL)) {
+        perror("calloc() error");
+        return(1);
+    }
+    for (id = 0; id < 32; id++) key[id] = (uint8_t)id;
+    for (id = 0; id < 24; id++) iv[id] = (uint8_t)(id + 0x40);
+
+    printf("{\n");
+#if defined(__VERSION__)
+    printf("  \"compiler\": \"%s\",\n", __VERSION__);
+#endif
+    printf("  \"cycle_counter\": %s,\n", HAVE_CYCLES ? "\"tsc\"" : "null");
+    printf("  \"default_kernel\": \"%s\",\n", xchacha_kernel_name(best));
+
+    print_latency("xchacha_init", measure(run_init, 0));
+    print_latency("xc_crypt_init", measure(run_crypt_init, 0));
+    xchacha_subkey_cache_init(&cache, 64);
+    xchacha_cache_key(&cache, key, &handle);
+    print_latency("xchacha_init_cached_hit", measure(run_init_cached, 0));
+    xchacha_subkey_cache_free(&cache);
+    {
+        sample s = measure(run_init_multi, 0);
+        s.ns /= 16;  s.cycles /= 16;  s.iterations *= 16;
+        print_latency("xchacha_init_multi_per_ctx", s);
+    }
+    for (id = 0; (id < 3) && (max >= BATCH * 1500); id++) {    // per message
+        static const size_t lens[3] = {100, 300, 1500};
+        char name[48];
+        sample s;
+        for (int m = 0; m < BATCH; m++) {
+            msgs[m] = (xchacha_msg){ key, &ivs[m * 24], &buf[m * lens[id]],
+                                     &buf[m * lens[id]], lens[id] };
+        }
+        s = measure(run_batch, 0);
+        s.ns /= BATCH;  s.cycles /= BATCH;  s.iterations *= BATCH;
+        snprintf(name, sizeof(name), "xchacha_encrypt_batch_%zu", lens[id]);
+        print_latency(name, s);
+        s = measure(run_batch_loop, 0);
+        s.ns /= BATCH;  s.cycles /= BATCH;  s.iterations *= BATCH;
+        snprintf(name, sizeof(name), "init_encrypt_loop_%zu", lens[id]);
+        print_latency(name, s);
+    }
+
+    size = (max < 65536) ? (max & ~(size_t)15) : 65536;
+    xc_crypt_init(&ctx, key, iv);
+    printf("  \"xc_crypt_block\": {\"size\": %zu, ", size);
+    print_rate("", measure(run_crypt_block, 0), (double)size);
+    printf("},\n");
+    printf("  \"xc_crypt_blocks\": {\"size\": %zu, ", size);
+    print_rate("", measure(run_crypt_blocks, 0), (double)size);
+    printf("},\n");
+
+    sample s = measure(run_random_u32, 0);
+    s.ns /= 1000;  s.cycles /= 1000;  s.iterations *= 1000;
+    print_latency("xchacha_random_u32", s);
+    size = 16;
+    print_latency("xchacha_random_bytes_16", measure(run_random_bytes, 0));
+    size = (max < 65536) ? max : 65536;
+    printf("  \"xchacha_random_bytes\": {\"size\": %zu, ", size);
+    print_rate("", measure(run_random_bytes, 0), (double)size);
+    printf("},\n");
+
+    for (id = 0; id < SIP_KEYS; id++) {
+        sip_msg[id] = &buf[(id * 16) % (max - 15)];
+        sip_len[id] = 16;
+    }
+    s = measure(run_siphash, 0);
+    s.ns /= SIP_KEYS;  s.cycles /= SIP_KEYS;  s.iterations *= SIP_KEYS;
+    print_latency("xc_siphash_16", s);
+    s = measure(run_siphash_batch, 0);
+    s.ns /= SIP_KEYS;  s.cycles /= SIP_KEYS;  s.iterations *= SIP_KEYS;
+    print_latency("xc_siphash_batch_16", s);
+
+    size = max;
+    xchacha_init(&ctx, key, iv);
+    printf("  \"encrypt_then_crc32c\": {\"size\": %zu, ", size);
+    print_rate("", measure(run_separate_crc, 0), (double)size);
+    printf("},\n");
+    printf("  \"xchacha_encrypt_crc32c\": {\"size\": %zu, ", size);
+    print_rate("", measure(run_fused_crc, 0), (double)size);
+    printf("},\n");
+
+    printf("  \"xchacha_encrypt_bytes\": [");
+    for (id = XC_KERNEL_SCALAR; id < XC_KERNELS; id++) {
+        if (xchacha_kernel_select(id) != 0) continue;
+        printf("%s\n    {\"kernel\": \"%s\", \"sizes\": [", first ? "" : ",",
+               xchacha_kernel_name(id));
+        first = 0;
+        for (size = 16; size <= max; size *= 4) {
+            xchacha_init(&ctx, key, iv);
+            printf("%s\n      {\"size\": %zu, ", (size == 16) ? "" : ",", size);
+            print_rate("", measure(run_encrypt, 0), (double)size);
+            printf("}");
+            fflush(stdout);
+        }
+        printf("\n    ]}");
+    }
+    printf("\n  ]\n}\n");
+    xchacha_kernel_select(best);
+    free(buf);
+    free(dst);
+    return(0);
+}
@@ -0,0 +1,339 @@
+/*************************************************************************
+ * Randomized differential test for every keystream path and kernel.     *
+ * Each case draws a key, nonce, position and length, computes the       *
+ * result with the small reference ChaCha below, then runs it through    *
+ * every library path on every kernel the CPU supports and compares.     *
+ * Throughput of each path is recorded in the same run.                  *
+ *     ./difftest [cases [seed]]                                         *
+ *************************************************************************/
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include "./src/xchacha.h"
+
+#define MAXLEN   (300 * 1024)           /* big enough for the parallel path */
+#define BYTE_MAX 4096                   /* per-byte path length cap */
+
+/* ------------------------------------------------------------------------- */
+// Reference: straight from the ChaCha and XChaCha specifications
+
+#define RROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define RQR(x, a, b, c, d)                                                    \
+    x[a] += x[b];  x[d] = RROTL(x[d] ^ x[a], 16);                             \
+    x[c] += x[d];  x[b] = RROTL(x[b] ^ x[c], 12);                             \
+    x[a] += x[b];  x[d] = RROTL(x[d] ^ x[a], 8);                              \
+    x[c] += x[d];  x[b] = RROTL(x[b] ^ x[c], 7);
+
+static uint32_t le32(const uint8_t *p){
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static void ref_rounds(uint32_t *x, int rounds){
+    for (int i = 0; i < rounds; i += 2) {
+        RQR(x, 0, 4,  8, 12)  RQR(x, 1, 5,  9, 13)  RQR(x, 2, 6, 10, 14)  RQR(x, 3, 7, 11, 15)
+        RQR(x, 0, 5, 10, 15)  RQR(x, 1, 6, 11, 12)  RQR(x, 2, 7,  8, 13)  RQR(x, 3, 4,  9, 14)
+    }
+}
+
+static void ref_state(uint32_t *s, const uint8_t *key, const uint8_t *nonce, int rounds){
+    uint32_t h[16] = { 0x61707865, 0x3320646e, 0x79622d32, 0x6b206574 };
+    int i;
+    for (i = 0; i < 8; i++) h[4 + i] = le32(&key[i * 4]);
+    for (i = 0; i < 4; i++) h[12 + i] = le32(&nonce[i * 4]);
+    ref_rounds(h, rounds);                                  /* HChaCha */
+    s[0] = 0x61707865; s[1] = 0x3320646e; s[2] = 0x79622d32; s[3] = 0x6b206574;
+    for (i = 0; i < 4; i++) { s[4 + i] = h[i]; s[8 + i] = h[12 + i]; }
+    s[12] = s[13] = 0;
+    s[14] = le32(&nonce[16]);
+    s[15] = le32(&nonce[20]);
+}
+
+/** XOR keystream from byte `ofs` of block `block` onward */
+static void ref_crypt(const uint8_t *key, const uint8_t *nonce, int rounds, uint64_t block,
+                      unsigned ofs, const uint8_t *in, uint8_t *out, size_t len){
+    uint32_t s[16], x[16];
+    uint8_t ks[64];
+    ref_state(s, key, nonce, rounds);
+    while (len) {
+        s[12] = (uint32_t)block;
+        s[13] = (uint32_t)(block >> 32);
+        memcpy(x, s, 64);
+        ref_rounds(x, rounds);
+        for (int i = 0; i < 16; i++) {
+            uint32_t v = x[i] + s[i];
+            ks[i*4] = (uint8_t)v;  ks[i*4 + 1] = (uint8_t)(v >> 8);
+            ks[i*4 + 2] = (uint8_t)(v >> 16);  ks[i*4 + 3] = (uint8_t)(v >> 24);
+        }
+        for (; ofs < 64 && len; ofs++, len--) *out++ = *in++ ^ ks[ofs];
+        ofs = 0;
+        block++;
+    }
+}
+
+static uint32_t ref_crc32c(const uint8_t *p, size_t len){
+    uint32_t c = 0xFFFFFFFF;
+    while (len--) {
+        c ^= *p++;
+        for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+    }
+    return ~c;
+}
+
+/* ------------------------------------------------------------------------- */
+
+static uint64_t seed;
+
+static uint64_t rnd(void){                  /* xorshift64* */
+    seed ^= seed >> 12;  seed ^= seed << 25;  seed ^= seed >> 27;
+    return seed * 0x2545F4914F6CDD1Dull;
+}
+
+static void fill(uint8_t *p, size_t len){
+    while (len--) *p++ = (uint8_t)rnd();
+}
+
+static size_t rnd_len(void){                /* mostly short, sometimes large */
+    switch (rnd() % 8) {
+    case 0:  return rnd() % MAXLEN;
+    case 1:  return rnd() % 64;
+    case 2:  return 64 * (rnd() % 64);
+    default: return rnd() % 3000;
+    }
+}
+
+static double now_ns(void){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+enum { P_BYTES, P_BULK, P_SPLIT, P_SEEK, P_WRAP, P_PARALLEL, P_BATCH, P_IOV, P_SECTORS,
+       P_RING, P_SESSION, P_CRC, P_BLOCKS16, P_ROUNDS12, P_ROUNDS8, NPATHS };
+
+static const char *path_name[NPATHS] = {
+    "per_byte", "bulk", "split", "seek", "counter_wrap", "parallel", "batch", "iov",
+    "sectors", "ring", "session", "crc32c", "xc_crypt_blocks", "xchacha12", "xchacha8"
+};
+
+static struct {
+    double bytes, ns;
+    unsigned cases, fails;
+} stat[XC_KERNELS][NPATHS];
+
+static uint8_t key[32], nonce[24], plain[MAXLEN], ref[MAXLEN], out[MAXLEN];
+static int kernel;
+
+/** Time one run of a path and compare out with ref */
+#define RUN(path, nbytes, ...) {                                              \
+    double t0 = now_ns();                                                     \
+    __VA_ARGS__                                                               \
+    stat[kernel][path].ns += now_ns() - t0;                                   \
+    stat[kernel][path].bytes += (double)(nbytes);                             \
+    stat[kernel][path].cases++;                                               \
+    if (memcmp(out, ref, nbytes) != 0) fail(path, nbytes);                    \
+}
+
+static void fail(int path, size_t len){
+    stat[kernel][path].fails++;
+    if (stat[kernel][path].fails <= 3) {
+        printf("MISMATCH kernel %s path %s len %zu\n", xchacha_kernel_name(kernel),
+               path_name[path], len);
+    }
+}
+
+static void one_case(void){
+    xChaCha_ctx ctx;
+    size_t len = rnd_len(), n, i;
+    uint64_t pos = rnd() % ((uint64_t)1 << (rnd() % 40));
+    uint64_t block;
+    uint8_t ctr[8];
+
+    fill(key, 32);
+    fill(nonce, 24);
+    fill(plain, len);
+    ref_crypt(key, nonce, 20, pos / 64, (unsigned)(pos % 64), plain, ref, len);
+
+    n = (len < BYTE_MAX) ? len : BYTE_MAX;
+    RUN(P_BYTES, n,
+        xchacha_init(&ctx, key, nonce);
+        xchacha_seek(&ctx, pos);
+        for (i = 0; i < n; i++) xchacha_encrypt_bytes(&ctx, &plain[i], &out[i], 1);)
+
+    RUN(P_BULK, len,
+        xchacha_init(&ctx, key, nonce);
+        xchacha_seek(&ctx, pos);
+        xchacha_encrypt(&ctx, plain, out, len);)
+
+    RUN(P_SPLIT, len,
+        xchacha_init(&ctx, key, nonce);
+        xchacha_seek(&ctx, pos);
+        for (i = 0; i < len; i += n) {
+            n = (rnd() & 1) ? rnd() % 200 : rnd() % 5000;
+            if (n > len - i) n = len - i;
+            xchacha_encrypt_bytes(&ctx, &plain[i], &out[i], (uint32_t)n);
+        })
+
+    n = len / 2;                            /* second half first, then the first */
+    RUN(P_SEEK, len,
+        xchacha_init(&ctx, key, nonce);
+        xchacha_seek(&ctx, pos + n);
+        xchacha_encrypt(&ctx, &plain[n], &out[n], len - n);
+        xchacha_seek(&ctx, pos);
+        xchacha_encrypt(&ctx, plain, out, n);)
+
+    RUN(P_PARALLEL, len,
+        xchacha_init(&ctx, key, nonce);
+        xchacha_seek(&ctx, pos);
+        xchacha_encrypt_parallel(&ctx, plain, out, len, 1 + (int)(rnd() % 4));)
+
+    RUN(P_IOV, len, {
+        xchacha_iovec in_v[16], out_v[16];
+        size_t a = 0, b = 0, ni, no;
+        for (ni = 0; ni < 15 && a < len; ni++, a += in_v[ni - 1].len) {
+            in_v[ni].base = &plain[a];
+            in_v[ni].len = rnd() % (len - a + 1);
+        }
+        in_v[ni].base = &plain[a];  in_v[ni++].len = len - a;
+        for (no = 0; no < 15 && b < len; no++, b += out_v[no - 1].len) {
+            out_v[no].base = &out[b];
+            out_v[no].len = rnd() % (len - b + 1);
+        }
+        out_v[no].base = &out[b];  out_v[no++].len = len - b;
+        xchacha_init(&ctx, key, nonce);
+        xchacha_seek(&ctx, pos);
+        xchacha_encrypt_iov(&ctx, in_v, ni, out_v, no);
+    })
+
+    RUN(P_RING, len, {
+        xchacha_ring ring;
+        xchacha_init(&ctx, key, nonce);
+        xchacha_seek(&ctx, pos);
+        xchacha_ring_init(&ring, &ctx, (size_t)16 << (rnd() % 5));
+        for (i = 0; i < len; i += n) {
+            if (rnd() & 1) xchacha_prefetch(&ring, rnd() % 8192);
+            n = rnd() % 3000;
+            if (n > len - i) n = len - i;
+            xchacha_ring_encrypt(&ring, &plain[i], &out[i], n);
+        }
+        xchacha_ring_free(&ring);
+    })
+
+    RUN(P_SESSION, len, {
+        xchacha_session s;
+        xchacha_session_init(&s, key, nonce);
+        s.pos = pos;
+        for (i = 0; i < len; i += n) {
+            n = rnd() % 3000;
+            if (n > len - i) n = len - i;
+            xchacha_session_encrypt(&s, &plain[i], &out[i], n);
+        }
+    })
+
+    {
+        uint32_t crc, expect = ref_crc32c(ref, len);
+        RUN(P_CRC, len,
+            xchacha_init(&ctx, key, nonce);
+            xchacha_seek(&ctx, pos);
+            crc = xchacha_encrypt_crc32c(&ctx, plain, out, len, 0);)
+        if (crc != expect) fail(P_CRC, len);
+    }
+
+    /* 64-bit counter: cross the low word and the whole counter wrapping */
+    block = ((rnd() & 1) ? 0xFFFFFFFFull : 0xFFFFFFFFFFFFFFFFull) - rnd() % 8;
+    n = (len < 2000) ? len : 2000;
+    ref_crypt(key, nonce, 20, block, 0, plain, ref, n);
+    for (i = 0; i < 8; i++) ctr[i] = (uint8_t)(block >> (i * 8));
+    RUN(P_WRAP, n,
+        xchacha_init(&ctx, key, nonce);
+        xchacha_set_counter(&ctx, ctr);
+        xchacha_encrypt(&ctx, plain, out, n);)
+
+    {                                       /* whole sectors */
+        size_t size = (size_t)64 << (rnd() % 7);
+        size_t count = len / size;
+        uint64_t first = rnd() % ((uint64_t)1 << 40);
+        ref_crypt(key, nonce, 20, first * (size / 64), 0, plain, ref, count * size);
+        RUN(P_SECTORS, count * size,
+            xchacha_init(&ctx, key, nonce);
+            xchacha_crypt_sectors(&ctx, first, size, count, plain, out);)
+    }
+
+    {                                       /* 16-byte IV, zero padded */
+        size_t nb = len / 16;
+        memset(&nonce[16], 0, 8);
+        ref_crypt(key, nonce, 20, 0, 0, plain, ref, nb * 16);
+        RUN(P_BLOCKS16, nb * 16,
+            xc_crypt_init(&ctx, key, nonce);
+            xc_crypt_blocks(&ctx, plain, out, nb / 2, XC_ENCRYPT);
+            xc_crypt_blocks(&ctx, &plain[(nb / 2) * 16], &out[(nb / 2) * 16], nb - nb / 2,
+                            XC_ENCRYPT);)
+    }
+
+    n = (len < 20000) ? len : 20000;        /* reduced rounds, portable only */
+    ref_crypt(key, nonce, 12, 0, 0, plain, ref, n);
+    RUN(P_ROUNDS12, n,
+        xchacha12_init(&ctx, key, nonce);
+        xchacha12_encrypt_bytes(&ctx, plain, out, (uint32_t)(n / 3));
+        xchacha12_encrypt_bytes(&ctx, &plain[n / 3], &out[n / 3], (uint32_t)(n - n / 3));)
+    ref_crypt(key, nonce, 8, 0, 0, plain, ref, n);
+    RUN(P_ROUNDS8, n,
+        xchacha8_init(&ctx, key, nonce);
+        xchacha8_encrypt_bytes(&ctx, plain, out, (uint32_t)n);)
+}
+
+static void batch_case(void){
+    static uint8_t keys[20][32], nonces[20][24];
+    xchacha_msg msgs[20];
+    size_t count = 1 + rnd() % 20, ofs = 0, i;
+    for (i = 0; i < count; i++) {
+        size_t len = (rnd() & 3) ? rnd() % 300 : rnd() % 5000;
+        if (len > MAXLEN / 20) len = MAXLEN / 20;
+        fill(keys[i], 32);
+        fill(nonces[i], 24);
+        fill(&plain[ofs], len);
+        ref_crypt(keys[i], nonces[i], 20, 0, 0, &plain[ofs], &ref[ofs], len);
+        msgs[i].key = keys[i];
+        msgs[i].nonce = nonces[i];
+        msgs[i].in = &plain[ofs];
+        msgs[i].out = &out[ofs];
+        msgs[i].len = len;
+        ofs += len;
+    }
+    RUN(P_BATCH, ofs, xchacha_encrypt_batch(msgs, count);)
+}
+
+int main(int argc, char *argv[]){
+    unsigned cases = 200, c;
+    unsigned long long fails = 0;
+    int best = xchacha_kernel(), p;
+
+    if (argc > 1) cases = (unsigned)strtoul(argv[1], 0, 0);
+    seed = (argc > 2) ? strtoull(argv[2], 0, 0) : (uint64_t)time(0);
+    if (!seed) seed = 1;
+    printf("seed %llu, %u cases per kernel\n", (unsigned long long)seed, cases);
+
+    for (kernel = XC_KERNEL_SCALAR; kernel < XC_KERNELS; kernel++) {
+        if (xchacha_kernel_select(kernel) != 0) continue;
+        for (c = 0; c < cases; c++) {
+            one_case();
+            batch_case();
+        }
+    }
+    xchacha_kernel_select(best);
+    xchacha_parallel_shutdown();
+
+    printf("%-8s %-16s %8s %10s %6s\n", "kernel", "path", "cases", "MB/s", "fails");
+    for (kernel = XC_KERNEL_SCALAR; kernel < XC_KERNELS; kernel++) {
+        for (p = 0; p < NPATHS; p++) {
+            if (!stat[kernel][p].cases) continue;
+            printf("%-8s %-16s %8u %10.1f %6u\n", xchacha_kernel_name(kernel), path_name[p],
+                   stat[kernel][p].cases, stat[kernel][p].bytes * 1e3 / stat[kernel][p].ns,
+                   stat[kernel][p].fails);
+            fails += stat[kernel][p].fails;
+        }
+    }
+    printf(fails ? "Differential test failed!\n" : "Differential test passed\n");
+    return fails ? 1 : 0;
+}
@@ -0,0 +1,230 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * Poly1305 one-time authenticator, after Andrew Moon's poly1305-donna.
+ * 64-bit hosts use three 44-bit limbs with 128-bit products; 32-bit targets
+ * (or -DXC_POLY1305_32) use five 26-bit limbs with 64-bit products.
+ */
+
+#include <stdint.h>
+#include <string.h>
+#include "xchacha.h"
+
+#if defined(__SIZEOF_INT128__) && !defined(XC_POLY1305_32)
+
+typedef unsigned __int128 u128;
+
+#define M44 0xFFFFFFFFFFFull
+#define M42 0x3FFFFFFFFFFull
+#define HIBIT (1ull << 40)              // 2^128 in the top limb
+
+static uint64_t u8tou64(const uint8_t *p) {
+    uint64_t v;
+    memcpy(&v, p, 8);                   // little-endian host assumed
+    return v;
+}
+
+void xc_poly1305_init(xc_poly1305_ctx *ctx, const uint8_t *key) {
+    uint64_t t0 = u8tou64(&key[0]);
+    uint64_t t1 = u8tou64(&key[8]);
+    ctx->r[0] = t0 & 0xFFC0FFFFFFFull;  // clamp r
+    ctx->r[1] = ((t0 >> 44) | (t1 << 20)) & 0xFFFFFC0FFFFull;
+    ctx->r[2] = (t1 >> 24) & 0x00FFFFFFC0Full;
+    ctx->h[0] = ctx->h[1] = ctx->h[2] = 0;
+    ctx->pad[0] = u8tou64(&key[16]);
+    ctx->pad[1] = u8tou64(&key[24]);
+    ctx->left = 0;
+}
+
+static void poly_blocks(xc_poly1305_ctx *ctx, const uint8_t *m, size_t bytes, uint64_t hibit) {
+    const uint64_t r0 = ctx->r[0], r1 = ctx->r[1], r2 = ctx->r[2];
+    const uint64_t s1 = r1 * (5 << 2), s2 = r2 * (5 << 2);
+    uint64_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2], c;
+    u128 d0, d1, d2;
+    while (bytes >= 16) {
+        uint64_t t0 = u8tou64(&m[0]);
+        uint64_t t1 = u8tou64(&m[8]);
+        h0 += t0 & M44;
+        h1 += ((t0 >> 44) | (t1 << 20)) & M44;
+        h2 += ((t1 >> 24) & M42) | hibit;
+        d0 = (u128)h0 * r0 + (u128)h1 * s2 + (u128)h2 * s1;
+        d1 = (u128)h0 * r1 + (u128)h1 * r0 + (u128)h2 * s2;
+        d2 = (u128)h0 * r2 + (u128)h1 * r1 + (u128)h2 * r0;
+        c = (uint64_t)(d0 >> 44);  h0 = (uint64_t)d0 & M44;
+        d1 += c;  c = (uint64_t)(d1 >> 44);  h1 = (uint64_t)d1 & M44;
+        d2 += c;  c = (uint64_t)(d2 >> 42);  h2 = (uint64_t)d2 & M42;
+        h0 += c * 5;  c = h0 >> 44;  h0 &= M44;
+        h1 += c;
+        m += 16;  bytes -= 16;
+    }
+    ctx->h[0] = h0;  ctx->h[1] = h1;  ctx->h[2] = h2;
+}
+
+static void poly_finish(xc_poly1305_ctx *ctx, uint8_t *mac) {
+    uint64_t h0 = ctx->h[0], h1 = ctx->h[1], h2 = ctx->h[2];
+    uint64_t g0, g1, g2, c, t0, t1;
+
+    c = h1 >> 44;  h1 &= M44;           // fully carry h
+    h2 += c;  c = h2 >> 42;  h2 &= M42;
+    h0 += c * 5;  c = h0 >> 44;  h0 &= M44;
+    h1 += c;  c = h1 >> 44;  h1 &= M44;
+    h2 += c;  c = h2 >> 42;  h2 &= M42;
+    h0 += c * 5;  c = h0 >> 44;  h0 &= M44;
+    h1 += c;
+
+    g0 = h0 + 5;  c = g0 >> 44;  g0 &= M44;     // g = h - p = h + 5 - 2^130
+    g1 = h1 + c;  c = g1 >> 44;  g1 &= M44;
+    g2 = h2 + c - (1ull << 42);
+
+    c = (g2 >> 63) - 1;                 // select h if h < p, or g otherwise
+    g0 &= c;  g1 &= c;  g2 &= c;
+    c = ~c;
+    h0 = (h0 & c) | g0;
+    h1 = (h1 & c) | g1;
+    h2 = (h2 & c) | g2;
+
+    t0 = ctx->pad[0];                   // h = (h + pad) mod 2^128
+    t1 = ctx->pad[1];
+    h0 += t0 & M44;  c = h0 >> 44;  h0 &= M44;
+    h1 += (((t0 >> 44) | (t1 << 20)) & M44) + c;  c = h1 >> 44;  h1 &= M44;
+    h2 += ((t1 >> 24) & M42) + c;  h2 &= M42;
+
+    h0 = h0 | (h1 << 44);
+    h1 = (h1 >> 20) | (h2 << 24);
+    memcpy(&mac[0], &h0, 8);
+    memcpy(&mac[8], &h1, 8);
+}
+
+#else // 26-bit limbs
+
+#define M26 0x3FFFFFF
+#define HIBIT (1ul << 24)               // 2^128 in the top limb
+
+static uint32_t u8tou32(const uint8_t *p) {
+    return ((uint32_t)p[0]) | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+void xc_poly1305_init(xc_poly1305_ctx *ctx, const uint8_t *key) {
+    ctx->r[0] = (u8tou32(&key[ 0])     ) & 0x3FFFFFF; // clamp r
+    ctx->r[1] = (u8tou32(&key[ 3]) >> 2) & 0x3FFFF03;
+    ctx->r[2] = (u8tou32(&key[ 6]) >> 4) & 0x3FFC0FF;
+    ctx->r[3] = (u8tou32(&key[ 9]) >> 6) & 0x3F03FFF;
+    ctx->r[4] = (u8tou32(&key[12]) >> 8) & 0x00FFFFF;
+    for (int i = 0; i < 5; i++) ctx->h[i] = 0;
+    ctx->pad[0] = u8tou32(&key[16]) | ((uint64_t)u8tou32(&key[20]) << 32);
+    ctx->pad[1] = u8tou32(&key[24]) | ((uint64_t)u8tou32(&key[28]) << 32);
+    ctx->left = 0;
+}
+
+static void poly_blocks(xc_poly1305_ctx *ctx, const uint8_t *m, size_t bytes, uint64_t hibit) {
+    const uint32_t r0 = (uint32_t)ctx->r[0], r1 = (uint32_t)ctx->r[1],
+                   r2 = (uint32_t)ctx->r[2], r3 = (uint32_t)ctx->r[3],
+                   r4 = (uint32_t)ctx->r[4];
+    const uint32_t s1 = r1 * 5, s2 = r2 * 5, s3 = r3 * 5, s4 = r4 * 5;
+    uint32_t h0 = (uint32_t)ctx->h[0], h1 = (uint32_t)ctx->h[1],
+             h2 = (uint32_t)ctx->h[2], h3 = (uint32_t)ctx->h[3],
+             h4 = (uint32_t)ctx->h[4], c;
+    uint64_t d0, d1, d2, d3, d4;
+    while (bytes >= 16) {
+        h0 += (u8tou32(&m[ 0])     ) & M26;
+        h1 += (u8tou32(&m[ 3]) >> 2) & M26;
+        h2 += (u8tou32(&m[ 6]) >> 4) & M26;
+        h3 += (u8tou32(&m[ 9]) >> 6) & M26;
+        h4 += (u8tou32(&m[12]) >> 8) | (uint32_t)hibit;
+        d0 = (uint64_t)h0*r0 + (uint64_t)h1*s4 + (uint64_t)h2*s3 + (uint64_t)h3*s2 + (uint64_t)h4*s1;
+        d1 = (uint64_t)h0*r1 + (uint64_t)h1*r0 + (uint64_t)h2*s4 + (uint64_t)h3*s3 + (uint64_t)h4*s2;
+        d2 = (uint64_t)h0*r2 + (uint64_t)h1*r1 + (uint64_t)h2*r0 + (uint64_t)h3*s4 + (uint64_t)h4*s3;
+        d3 = (uint64_t)h0*r3 + (uint64_t)h1*r2 + (uint64_t)h2*r1 + (uint64_t)h3*r0 + (uint64_t)h4*s4;
+        d4 = (uint64_t)h0*r4 + (uint64_t)h1*r3 + (uint64_t)h2*r2 + (uint64_t)h3*r1 + (uint64_t)h4*r0;
+        c = (uint32_t)(d0 >> 26);  h0 = (uint32_t)d0 & M26;
+        d1 += c;  c = (uint32_t)(d1 >> 26);  h1 = (uint32_t)d1 & M26;
+        d2 += c;  c = (uint32_t)(d2 >> 26);  h2 = (uint32_t)d2 & M26;
+        d3 += c;  c = (uint32_t)(d3 >> 26);  h3 = (uint32_t)d3 & M26;
+        d4 += c;  c = (uint32_t)(d4 >> 26);  h4 = (uint32_t)d4 & M26;
+        h0 += c * 5;  c = h0 >> 26;  h0 &= M26;
+        h1 += c;
+        m += 16;  bytes -= 16;
+    }
+    ctx->h[0] = h0;  ctx->h[1] = h1;  ctx->h[2] = h2;  ctx->h[3] = h3;  ctx->h[4] = h4;
+}
+
+static void poly_finish(xc_poly1305_ctx *ctx, uint8_t *mac) {
+    uint32_t h0 = (uint32_t)ctx->h[0], h1 = (uint32_t)ctx->h[1],
+             h2 = (uint32_t)ctx->h[2], h3 = (uint32_t)ctx->h[3],
+             h4 = (uint32_t)ctx->h[4];
+    uint32_t g0, g1, g2, g3, g4, c, mask;
+    uint64_t f;
+
+    c = h1 >> 26;  h1 &= M26;           // fully carry h
+    h2 += c;  c = h2 >> 26;  h2 &= M26;
+    h3 += c;  c = h3 >> 26;  h3 &= M26;
+    h4 += c;  c = h4 >> 26;  h4 &= M26;
+    h0 += c * 5;  c = h0 >> 26;  h0 &= M26;
+    h1 += c;
+
+    g0 = h0 + 5;  c = g0 >> 26;  g0 &= M26;     // g = h - p = h + 5 - 2^130
+    g1 = h1 + c;  c = g1 >> 26;  g1 &= M26;
+    g2 = h2 + c;  c = g2 >> 26;  g2 &= M26;
+    g3 = h3 + c;  c = g3 >> 26;  g3 &= M26;
+    g4 = h4 + c - (1ul << 26);
+
+    mask = (g4 >> 31) - 1;              // select h if h < p, or g otherwise
+    g0 &= mask;  g1 &= mask;  g2 &= mask;  g3 &= mask;  g4 &= mask;
+    mask = ~mask;
+    h0 = (h0 & mask) | g0;
+    h1 = (h1 & mask) | g1;
+    h2 = (h2 & mask) | g2;
+    h3 = (h3 & mask) | g3;
+    h4 = (h4 & mask) | g4;
+
+    h0 = ((h0      ) | (h1 << 26));     // h = h % 2^128
+    h1 = ((h1 >>  6) | (h2 << 20));
+    h2 = ((h2 >> 12) | (h3 << 14));
+    h3 = ((h3 >> 18) | (h4 <<  8));
+
+    f = (uint64_t)h0 + (uint32_t)ctx->pad[0];              h0 = (uint32_t)f;
+    f = (uint64_t)h1 + (uint32_t)(ctx->pad[0] >> 32) + (f >> 32);  h1 = (uint32_t)f;
+    f = (uint64_t)h2 + (uint32_t)ctx->pad[1] + (f >> 32);  h2 = (uint32_t)f;
+    f = (uint64_t)h3 + (uint32_t)(ctx->pad[1] >> 32) + (f >> 32);  h3 = (uint32_t)f;
+
+    memcpy(&mac[ 0], &h0, 4);
+    memcpy(&mac[ 4], &h1, 4);
+    memcpy(&mac[ 8], &h2, 4);
+    memcpy(&mac[12], &h3, 4);
+}
+
+#endif
+
+/* ------------------------------------------------------------------------- */
+
+void xc_poly1305_update(xc_poly1305_ctx *ctx, const uint8_t *m, size_t bytes) {
+    if (ctx->left) {                    // top up a partial block
+        size_t want = 16 - ctx->left;
+        if (want > bytes) want = bytes;
+        memcpy(&ctx->buf[ctx->left], m, want);
+        ctx->left += (uint32_t)want;
+        m += want;  bytes -= want;
+        if (ctx->left < 16) return;
+        poly_blocks(ctx, ctx->buf, 16, HIBIT);
+        ctx->left = 0;
+    }
+    if (bytes >= 16) {
+        poly_blocks(ctx, m, bytes & ~(size_t)15, HIBIT);
+        m += bytes & ~(size_t)15;
+        bytes &= 15;
+    }
+    if (bytes) {
+        memcpy(ctx->buf, m, bytes);
+        ctx->left = (uint32_t)bytes;
+    }
+}
+
+void xc_poly1305_final(xc_poly1305_ctx *ctx, uint8_t *mac) {
+    if (ctx->left) {                    // 1 byte then zeros, no 2^128 bit
+        ctx->buf[ctx->left] = 1;
+        memset(&ctx->buf[ctx->left + 1], 0, 15 - ctx->left);
+        poly_blocks(ctx, ctx->buf, 16, 0);
+    }
+    poly_finish(ctx, mac);
+    memset(ctx, 0, sizeof(*ctx));
+}
@@ -0,0 +1,80 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * SipHash-2-4 and HalfSipHash-2-4, Aumasson and Bernstein,
+ * https://github.com/veorq/SipHash
+ * SipHash gives 64-bit results from a 16-byte key. HalfSipHash works on
+ * 32-bit words for small targets and gives 32-bit results from an 8-byte key.
+ * The batch call hashes several messages at once on x86, one per 64-bit lane.
+ */
+
+#include "xchacha.h"
+#include "xchacha_internal.h"
+
+#define ROTL64(v, n) (((v) << (n)) | ((v) >> (64 - (n))))
+
+#define SIPROUND                                                              \
+    v0 += v1;  v1 = ROTL64(v1, 13);  v1 ^= v0;  v0 = ROTL64(v0, 32);          \
+    v2 += v3;  v3 = ROTL64(v3, 16);  v3 ^= v2;                                \
+    v0 += v3;  v3 = ROTL64(v3, 21);  v3 ^= v0;                                \
+    v2 += v1;  v1 = ROTL64(v1, 17);  v1 ^= v2;  v2 = ROTL64(v2, 32);
+
+#define HALFROUND                                                             \
+    v0 += v1;  v1 = ROTL32(v1, 5);   v1 ^= v0;  v0 = ROTL32(v0, 16);          \
+    v2 += v3;  v3 = ROTL32(v3, 8);   v3 ^= v2;                                \
+    v0 += v3;  v3 = ROTL32(v3, 7);   v3 ^= v0;                                \
+    v2 += v1;  v1 = ROTL32(v1, 13);  v1 ^= v2;  v2 = ROTL32(v2, 16);
+
+uint64_t xc_siphash(const uint8_t *key, const uint8_t *m, size_t len) {
+    uint64_t k0 = xc_sip_word(key, 16, 0), k1 = xc_sip_word(key, 16, 1);
+    uint64_t v0 = k0 ^ 0x736f6d6570736575ull, v1 = k1 ^ 0x646f72616e646f6dull;
+    uint64_t v2 = k0 ^ 0x6c7967656e657261ull, v3 = k1 ^ 0x7465646279746573ull;
+    for (size_t b = 0; b <= len / 8; b++) {
+        uint64_t w = xc_sip_word(m, len, b);
+        v3 ^= w;
+        SIPROUND  SIPROUND
+        v0 ^= w;
+    }
+    v2 ^= 0xff;
+    SIPROUND  SIPROUND  SIPROUND  SIPROUND
+    return v0 ^ v1 ^ v2 ^ v3;
+}
+
+uint32_t xc_halfsiphash(const uint8_t *key, const uint8_t *m, size_t len) {
+    uint32_t k0 = xc_load32(key), k1 = xc_load32(&key[4]);
+    uint32_t v0 = k0, v1 = k1, v2 = k0 ^ 0x6c796765, v3 = k1 ^ 0x74656462;
+    size_t i, tail = len & 3;
+    uint32_t w;
+    for (i = 0; i + 4 <= len; i += 4) {
+        w = xc_load32(&m[i]);
+        v3 ^= w;
+        HALFROUND  HALFROUND
+        v0 ^= w;
+    }
+    w = (uint32_t)len << 24;
+    while (tail--) w |= (uint32_t)m[i + tail] << (tail * 8);
+    v3 ^= w;
+    HALFROUND  HALFROUND
+    v0 ^= w;
+    v2 ^= 0xff;
+    HALFROUND  HALFROUND  HALFROUND  HALFROUND
+    return v1 ^ v3;
+}
+
+void xc_siphash_batch(const uint8_t *key, const uint8_t *const *m, const size_t *len,
+                      uint64_t *out, size_t count) {
+#ifdef XC_X86_KERNELS
+    uint64_t k[2] = { xc_sip_word(key, 16, 0), xc_sip_word(key, 16, 1) };
+    int id = xchacha_kernel();
+    if (id >= XC_KERNEL_AVX512) {
+        for (; count >= 8; count -= 8, m += 8, len += 8, out += 8) {
+            xc_siphash_x8_avx512(k, m, len, out);
+        }
+    }
+    if (id >= XC_KERNEL_AVX2) {
+        for (; count >= 4; count -= 4, m += 4, len += 4, out += 4) {
+            xc_siphash_x4_avx2(k, m, len, out);
+        }
+    }
+#endif
+    while (count--) *out++ = xc_siphash(key, *m++, *len++);
+}
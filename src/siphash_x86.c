@@ -0,0 +1,117 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * SipHash-2-4 over 4 (AVX2) or 8 (AVX-512F) messages at once, one message
+ * per 64-bit lane, all under the same key. Message words are gathered on
+ * the scalar side; a lane whose message has ended keeps its state while the
+ * longer ones finish, then all lanes finalize together.
+ */
+
+#include <string.h>
+#include "xchacha_internal.h"
+
+#ifdef XC_X86_KERNELS
+#include <immintrin.h>
+
+#define C0 0x736f6d6570736575ull
+#define C1 0x646f72616e646f6dull
+#define C2 0x6c7967656e657261ull
+#define C3 0x7465646279746573ull
+
+#define XC_SIPROUND(P)                                                        \
+    v0 = P##_ADD(v0, v1);  v1 = P##_ROT(v1, 13);  v1 = P##_XOR(v1, v0);       \
+    v0 = P##_R32(v0);                                                         \
+    v2 = P##_ADD(v2, v3);  v3 = P##_ROT(v3, 16);  v3 = P##_XOR(v3, v2);       \
+    v0 = P##_ADD(v0, v3);  v3 = P##_ROT(v3, 21);  v3 = P##_XOR(v3, v0);       \
+    v2 = P##_ADD(v2, v1);  v1 = P##_ROT(v1, 17);  v1 = P##_XOR(v1, v2);       \
+    v2 = P##_R32(v2);
+
+// Gather word b of every lane's message; x86 is little-endian
+#define XC_GATHER(lanes)                                                      \
+    for (l = 0; l < lanes; l++) {                                             \
+        if (b + 1 < words[l]) memcpy(&w[l], &m[l][b*8], 8);                   \
+        else w[l] = (b + 1 == words[l]) ? xc_sip_word(m[l], len[l], b) : 0;   \
+    }
+
+/* ------------------------------------------------------------------------- */
+// AVX2, 4 lanes
+
+#define AVX_ADD(a, b) _mm256_add_epi64(a, b)
+#define AVX_XOR(a, b) _mm256_xor_si256(a, b)
+#define AVX_ROT(v, n) _mm256_or_si256(_mm256_slli_epi64(v, n), _mm256_srli_epi64(v, 64 - (n)))
+#define AVX_R32(v) _mm256_shuffle_epi32(v, 0xB1)
+
+__attribute__((target("avx2")))
+void xc_siphash_x4_avx2(const uint64_t *k, const uint8_t *const *m, const size_t *len, uint64_t *out) {
+    __m256i v0 = _mm256_set1_epi64x((long long)(k[0] ^ C0));
+    __m256i v1 = _mm256_set1_epi64x((long long)(k[1] ^ C1));
+    __m256i v2 = _mm256_set1_epi64x((long long)(k[0] ^ C2));
+    __m256i v3 = _mm256_set1_epi64x((long long)(k[1] ^ C3));
+    uint64_t words[4], most = 0, b;
+    __m256i nw;
+    int l;
+    for (l = 0; l < 4; l++) {
+        words[l] = len[l] / 8 + 1;
+        if (words[l] > most) most = words[l];
+    }
+    nw = _mm256_loadu_si256((const __m256i *)words);    // lane runs while b < words
+    for (b = 0; b < most; b++) {
+        uint64_t w[4];
+        __m256i x, on, u0 = v0, u1 = v1, u2 = v2, u3 = v3;
+        XC_GATHER(4)
+        x = _mm256_loadu_si256((const __m256i *)w);
+        on = _mm256_cmpgt_epi64(nw, _mm256_set1_epi64x((long long)b));
+        v3 = AVX_XOR(v3, x);
+        XC_SIPROUND(AVX)  XC_SIPROUND(AVX)
+        v0 = AVX_XOR(v0, x);
+        v0 = _mm256_blendv_epi8(u0, v0, on);
+        v1 = _mm256_blendv_epi8(u1, v1, on);
+        v2 = _mm256_blendv_epi8(u2, v2, on);
+        v3 = _mm256_blendv_epi8(u3, v3, on);
+    }
+    v2 = AVX_XOR(v2, _mm256_set1_epi64x(0xff));
+    XC_SIPROUND(AVX)  XC_SIPROUND(AVX)  XC_SIPROUND(AVX)  XC_SIPROUND(AVX)
+    _mm256_storeu_si256((__m256i *)out, AVX_XOR(AVX_XOR(v0, v1), AVX_XOR(v2, v3)));
+}
+
+/* ------------------------------------------------------------------------- */
+// AVX-512F, 8 lanes
+
+#define Z_ADD(a, b) _mm512_add_epi64(a, b)
+#define Z_XOR(a, b) _mm512_xor_si512(a, b)
+#define Z_ROT(v, n) _mm512_rol_epi64(v, n)
+#define Z_R32(v) _mm512_rol_epi64(v, 32)
+
+__attribute__((target("avx512f")))
+void xc_siphash_x8_avx512(const uint64_t *k, const uint8_t *const *m, const size_t *len, uint64_t *out) {
+    __m512i v0 = _mm512_set1_epi64((long long)(k[0] ^ C0));
+    __m512i v1 = _mm512_set1_epi64((long long)(k[1] ^ C1));
+    __m512i v2 = _mm512_set1_epi64((long long)(k[0] ^ C2));
+    __m512i v3 = _mm512_set1_epi64((long long)(k[1] ^ C3));
+    uint64_t words[8], most = 0, b;
+    __m512i nw;
+    int l;
+    for (l = 0; l < 8; l++) {
+        words[l] = len[l] / 8 + 1;
+        if (words[l] > most) most = words[l];
+    }
+    nw = _mm512_loadu_si512(words);
+    for (b = 0; b < most; b++) {
+        uint64_t w[8];
+        __m512i x, u0 = v0, u1 = v1, u2 = v2, u3 = v3;
+        __mmask8 on = _mm512_cmpgt_epu64_mask(nw, _mm512_set1_epi64((long long)b));
+        XC_GATHER(8)
+        x = _mm512_loadu_si512(w);
+        v3 = Z_XOR(v3, x);
+        XC_SIPROUND(Z)  XC_SIPROUND(Z)
+        v0 = Z_XOR(v0, x);
+        v0 = _mm512_mask_mov_epi64(u0, on, v0);
+        v1 = _mm512_mask_mov_epi64(u1, on, v1);
+        v2 = _mm512_mask_mov_epi64(u2, on, v2);
+        v3 = _mm512_mask_mov_epi64(u3, on, v3);
+    }
+    v2 = Z_XOR(v2, _mm512_set1_epi64(0xff));
+    XC_SIPROUND(Z)  XC_SIPROUND(Z)  XC_SIPROUND(Z)  XC_SIPROUND(Z)
+    _mm512_storeu_si512(out, Z_XOR(Z_XOR(v0, v1), Z_XOR(v2, v3)));
+}
+
+#endif // XC_X86_KERNELS
@@ -6,14 +6,18 @@
 #include <stdint.h>
 #include <string.h>
 #include "xchacha.h"
+#include "xchacha_internal.h"
+
+#ifdef XCHACHA_SMALL
 
 static const uint8_t ind[32] = {
     0, 4, 8, 12, 1, 5, 9, 13, 2, 6, 10, 14, 3, 7, 11, 15,
     0, 5, 10, 15, 1, 6, 11, 12, 2, 7, 8, 13, 3, 4, 9, 14
 };
 
-static void doRounds(uint32_t *x) {
-    for (int i = 0; i < 10; i++){
+// Minimum footprint: one quarter round reached through the index table
+static void rounds(uint32_t *x, int doubles) {
+    for (int i = 0; i < doubles; i++){
         for (int j = 0; j < 8; j++) {
             const uint8_t * p = &ind[j*4];  // eliminate QUARTERROUND macro
             x[p[0]] += x[p[1]];  x[p[3]] = ROTL32(x[p[3]] ^ x[p[0]], 16);
@@ -24,6 +28,46 @@ static void doRounds(uint32_t *x) {
     }
 }
 
+static void doRounds(uint32_t *x)   { rounds(x, 10); }
+static void doRounds12(uint32_t *x) { rounds(x, 6); }
+static void doRounds8(uint32_t *x)  { rounds(x, 4); }
+
+#else
+
+// Fully unrolled with constant indices, so the state can live in registers
+#define QR(a, b, c, d)                                                        \
+    x##a += x##b;  x##d = ROTL32(x##d ^ x##a, 16);                            \
+    x##c += x##d;  x##b = ROTL32(x##b ^ x##c, 12);                            \
+    x##a += x##b;  x##d = ROTL32(x##d ^ x##a, 8);                             \
+    x##c += x##d;  x##b = ROTL32(x##b ^ x##c, 7);
+
+#define DOUBLEROUND                                                           \
+    QR(0, 4,  8, 12)  QR(1, 5,  9, 13)  QR(2, 6, 10, 14)  QR(3, 7, 11, 15)    \
+    QR(0, 5, 10, 15)  QR(1, 6, 11, 12)  QR(2, 7,  8, 13)  QR(3, 4,  9, 14)
+
+#define ROUNDS_8  DOUBLEROUND DOUBLEROUND DOUBLEROUND DOUBLEROUND
+#define ROUNDS_12 ROUNDS_8 DOUBLEROUND DOUBLEROUND
+#define ROUNDS_20 ROUNDS_12 ROUNDS_8
+
+#define CHACHA_ROUNDS(name, n)                                                \
+static void name(uint32_t *x) {                                               \
+    uint32_t x0  = x[0],  x1  = x[1],  x2  = x[2],  x3  = x[3];               \
+    uint32_t x4  = x[4],  x5  = x[5],  x6  = x[6],  x7  = x[7];               \
+    uint32_t x8  = x[8],  x9  = x[9],  x10 = x[10], x11 = x[11];              \
+    uint32_t x12 = x[12], x13 = x[13], x14 = x[14], x15 = x[15];              \
+    ROUNDS_##n                                                                \
+    x[0]  = x0;   x[1]  = x1;   x[2]  = x2;   x[3]  = x3;                     \
+    x[4]  = x4;   x[5]  = x5;   x[6]  = x6;   x[7]  = x7;                     \
+    x[8]  = x8;   x[9]  = x9;   x[10] = x10;  x[11] = x11;                    \
+    x[12] = x12;  x[13] = x13;  x[14] = x14;  x[15] = x15;                    \
+}
+
+CHACHA_ROUNDS(doRounds,   20)
+CHACHA_ROUNDS(doRounds12, 12)
+CHACHA_ROUNDS(doRounds8,   8)
+
+#endif // XCHACHA_SMALL
+
 static uint32_t u8tou32(const uint8_t *p) {
     return                              // This little gem handles alignment
   (((uint32_t)(p[0])      ) |           // even if the CPU doesn't.
@@ -36,10 +80,12 @@ static void u32tou8(uint8_t *p, uint32_t v) {
     memcpy(p, &v, 4);                   // 8-bit --> 32-bit little-endian
 }
 
-void xchacha_hchacha20(uint8_t *out, const uint8_t *in, const uint8_t *k){
+static void hchacha(uint8_t *out, const uint8_t *in, const uint8_t *k,
+                    void (*rounds)(uint32_t *)){
     int i;
     uint32_t x[16];
 
+    XC_STAT(hchacha, 1);
     x[0] = 0x61707865;                  // XChaCha Constant
     x[1] = 0x3320646e;
     x[2] = 0x79622d32;
@@ -50,76 +96,340 @@ void xchacha_hchacha20(uint8_t *out, const uint8_t *in, const uint8_t *k){
         x[i+ 8] = u8tou32(&k[i*4+16]);
         x[i+12] = u8tou32(&in[i*4]);
     }
-    doRounds(x);
+    rounds(x);
     for (i = 0; i < 4; i++){
         u32tou8(out + i*4, x[i]);
         u32tou8(out + i*4 + 16, x[i+12]);
     }
 }
 
-void xchacha_init(xChaCha_ctx *ctx, const uint8_t *k, uint8_t *iv){
-    /* The sub-key to use */
-    uint8_t k2[32];
+void xchacha_hchacha20(uint8_t *out, const uint8_t *in, const uint8_t *k){
+    hchacha(out, in, k, doRounds);
+}
+
+void xc_ctx_setup(xChaCha_ctx *ctx, const uint8_t *subkey, uint32_t n0, uint32_t n1){
     int i;
-    xchacha_hchacha20(k2, iv, k);
     ctx->input[0] = 0x61707865;
     ctx->input[1] = 0x3320646e;
     ctx->input[2] = 0x79622d32;
     ctx->input[3] = 0x6b206574;
     for (i = 0; i < 8; i++) {   // load the key
-        ctx->input[i + 4] = u8tou32(&k2[i*4]);
+        ctx->input[i + 4] = u8tou32(&subkey[i*4]);
     }
     ctx->input[12] = 0;         /* Internal counter */
     ctx->input[13] = 0;         /* Internal counter */
-    ctx->input[14] = u8tou32(iv + 16);
-    ctx->input[15] = u8tou32(iv + 20);
+    ctx->input[14] = n0;
+    ctx->input[15] = n1;
     ctx->chaptr = 64;
     ctx->blox = 0;
 }
 
+static void init(xChaCha_ctx *ctx, const uint8_t *k, const uint8_t *iv,
+                 void (*rounds)(uint32_t *)){
+    /* The sub-key to use */
+    uint8_t k2[32];
+    XC_STAT(inits, 1);
+    hchacha(k2, iv, k, rounds);
+    xc_ctx_setup(ctx, k2, u8tou32(iv + 16), u8tou32(iv + 20));
+}
+
+void xchacha_init(xChaCha_ctx *ctx, const uint8_t *k, const uint8_t *iv){
+    XC_TIMER(t);
+    init(ctx, k, iv, doRounds);
+    XC_TIMED(t, init_cycles);
+}
+
 void xchacha_set_counter(xChaCha_ctx *ctx, uint8_t *counter){
     ctx->input[12] = u8tou32(&counter[0]);
     ctx->input[13] = u8tou32(&counter[4]);
+    ctx->chaptr = 64;           // buffered keystream belongs to the old counter
+}
+
+/* Generate one 64-byte keystream block into x and advance the block counter */
+#define CHACHA_BLOCK(name, rounds)                                            \
+static void name(uint32_t *input, uint32_t *x) {                              \
+    memcpy(x, input, 64);                                                     \
+    rounds(x);                                                                \
+    for (int i = 0; i < 16; i++) {                                            \
+        x[i] += input[i];                                                     \
+    }                                                                         \
+    if (!++input[12]) input[13]++;                                            \
+    XC_STAT(blocks[XC_KERNEL_SCALAR], 1);                                     \
 }
 
+CHACHA_BLOCK(chacha_block,   doRounds)
+CHACHA_BLOCK(chacha12_block, doRounds12)
+CHACHA_BLOCK(chacha8_block,  doRounds8)
+
 uint8_t xchacha_next(xChaCha_ctx *ctx){
     if (ctx->chaptr > 63) {
         ctx->chaptr = 0;
-        uint32_t x[16], j[16];
-        memcpy(j, &ctx->input, 64);
-        memcpy(x, j, 64);
-        doRounds(x);
+        uint32_t x[16];
+        chacha_block(ctx->input, x);
+        memcpy(ctx->chabuf, x, 64);
+    }
+    return ctx->chabuf[ctx->chaptr++];
+}
+
+void xchacha_seek(xChaCha_ctx *ctx, uint64_t byte_offset){
+    ctx->input[12] = (uint32_t)(byte_offset >> 6);
+    ctx->input[13] = (uint32_t)(byte_offset >> 38);
+    ctx->chaptr = 64;
+    if (byte_offset & 63) {     // regenerate only the block being entered
+        xchacha_next(ctx);
+        ctx->chaptr = (uint8_t)(byte_offset & 63);
+    }
+}
+
+uint64_t xchacha_tell(const xChaCha_ctx *ctx){
+    uint64_t block = ((uint64_t)ctx->input[13] << 32) | ctx->input[12];
+    if (ctx->chaptr < 64) {     // chabuf holds the block before the counter
+        return (block - 1) * 64 + ctx->chaptr;
+    }
+    return block * 64;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// Multi-block kernels, widest last. Portable C is always available.
+
+static const struct {
+    const char *name;
+    xc_kernel_fn fn;
+} kernels[XC_KERNELS] = {
+    { "scalar", 0 },
+#ifdef XC_VEC_KERNEL
+    { "vec",    xc_blocks_vec },
+#else
+    { "vec",    0 },
+#endif
+#ifdef XC_X86_KERNELS
+    { "sse2",   xc_blocks_sse2 },
+    { "avx2",   xc_blocks_avx2 },
+    { "avx512", xc_blocks_avx512 },
+#else
+    { "sse2",   0 },
+    { "avx2",   0 },
+    { "avx512", 0 },
+#endif
+};
+
+// Both are read and written with relaxed atomics: any thread may get there
+// first, and every thread computes the same values
+static int caps;                            // bit id set if kernel id runs here, 0 = not yet
+static int kernel = -1;                     // selected kernel, -1 = not yet
+
+static int detect(void) {
+    int m = 1 << XC_KERNEL_SCALAR;
+    if (kernels[XC_KERNEL_VEC].fn) m |= 1 << XC_KERNEL_VEC;
+#ifdef XC_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse2"))    m |= 1 << XC_KERNEL_SSE2;
+    if (__builtin_cpu_supports("avx2"))    m |= 1 << XC_KERNEL_AVX2;
+    if (__builtin_cpu_supports("avx512f")) m |= 1 << XC_KERNEL_AVX512;
+#endif
+    __atomic_store_n(&caps, m, __ATOMIC_RELAXED);
+    return m;
+}
+
+static int kernel_ok(int id) {
+    int m = __atomic_load_n(&caps, __ATOMIC_RELAXED);
+    if ((id < 0) || (id >= XC_KERNELS)) return 0;
+    if (!m) m = detect();
+    return (m >> id) & 1;
+}
+
+int xchacha_kernel(void) {
+    int k = __atomic_load_n(&kernel, __ATOMIC_RELAXED);
+    if (k < 0) {
+        k = XC_KERNELS - 1;
+        while (!kernel_ok(k)) k--;
+        __atomic_store_n(&kernel, k, __ATOMIC_RELAXED);
+    }
+    return k;
+}
+
+int xchacha_kernel_select(int id) {
+    if (!kernel_ok(id)) return -1;
+    __atomic_store_n(&kernel, id, __ATOMIC_RELAXED);
+    return 0;
+}
+
+const char *xchacha_kernel_name(int id) {
+    if ((id < 0) || (id >= XC_KERNELS)) return "";
+    return kernels[id].name;
+}
+
+void xc_blocks(uint32_t *input, const uint8_t *in, uint8_t *out, size_t blocks) {
+    for (int id = xchacha_kernel(); (id > XC_KERNEL_SCALAR) && blocks; id--) {
+        if (kernel_ok(id)) {
+            size_t n = kernels[id].fn(input, in, out, blocks);
+            XC_STAT(blocks[id], n);
+            if (in) in += n * 64;
+            out += n * 64;
+            blocks -= n;
+        }
+    }
+    while (blocks--) {                      // scalar, one block at a time
+        uint32_t x[16];
+        chacha_block(input, x);
         for (int i = 0; i < 16; i++) {
-            x[i] += j[i];
+            u32tou8(&out[i*4], in ? u8tou32(&in[i*4]) ^ x[i] : x[i]);
         }
+        if (in) in += 64;
+        out += 64;
+    }
+}
+
+int xc_lanes(void) {
+    switch (xchacha_kernel()) {
+    case XC_KERNEL_AVX512: return 16;
+    case XC_KERNEL_AVX2:   return 8;
+    case XC_KERNEL_SSE2:
+    case XC_KERNEL_VEC:    return 4;
+    }
+    return 1;
+}
+
+int xc_rounds_lanes(uint32_t *s, int lanes) {
+#ifdef XC_X86_KERNELS
+    if ((lanes == 16) && kernel_ok(XC_KERNEL_AVX512)) { xc_rounds_x16_avx512(s); return XC_KERNEL_AVX512; }
+    if ((lanes == 8)  && kernel_ok(XC_KERNEL_AVX2))   { xc_rounds_x8_avx2(s);    return XC_KERNEL_AVX2; }
+    if ((lanes == 4)  && kernel_ok(XC_KERNEL_SSE2))   { xc_rounds_x4_sse2(s);    return XC_KERNEL_SSE2; }
+#endif
+#ifdef XC_VEC_KERNEL
+    if (lanes == 4) { xc_rounds_x4_vec(s); return XC_KERNEL_VEC; }
+#endif
+    for (int l = 0; l < lanes; l++) {
+        uint32_t x[16];
+        int i;
+        for (i = 0; i < 16; i++) x[i] = s[i*lanes + l];
+        doRounds(x);
+        for (i = 0; i < 16; i++) s[i*lanes + l] = x[i];
+    }
+    return XC_KERNEL_SCALAR;
+}
+
+/* ------------------------------------------------------------------------- */
+
+// Whole blocks through `bulk`, odd bytes through chabuf using `block`
+static void crypt(xChaCha_ctx *ctx, const uint8_t *m, uint8_t *c, size_t bytes,
+                  void (*block)(uint32_t *, uint32_t *),
+                  void (*bulk)(uint32_t *, const uint8_t *, uint8_t *, size_t)){
+    XC_STAT(bytes, bytes);
+    while (bytes && (ctx->chaptr < 64)) {   // use up leftover keystream first
+        *c++ = *m++ ^ ctx->chabuf[ctx->chaptr++];
+        bytes--;
+    }
+    if (bytes >= 64) {                      // whole blocks bypass chabuf
+        bulk(ctx->input, m, c, bytes / 64);
+        m += bytes & ~(size_t)63;
+        c += bytes & ~(size_t)63;
+        bytes &= 63;
+    }
+    if (bytes) {                            // partial block goes through chabuf
+        uint32_t x[16];
+        block(ctx->input, x);
         memcpy(ctx->chabuf, x, 64);
-        j[12]++;
-        if (!j[12]) j[13]++;
-        ctx->input[12] = j[12];
-        ctx->input[13] = j[13];
+        ctx->chaptr = 0;
+        while (bytes--) {
+            *c++ = *m++ ^ ctx->chabuf[ctx->chaptr++];
+        }
     }
-    return ctx->chabuf[ctx->chaptr++];
 }
 
 void xchacha_encrypt_bytes(xChaCha_ctx *ctx, const uint8_t *m, uint8_t *c, uint32_t bytes){
-    while (bytes--) {
-        *c++ = *m++ ^ xchacha_next(ctx);
-    }
+    XC_TIMER(t);
+    crypt(ctx, m, c, bytes, chacha_block, xc_blocks);
+    XC_TIMED(t, encrypt_cycles);
+}
+
+/* Reduced-round variants for non-critical keystream: portable C only */
+#define SCALAR_BLOCKS(name, block)                                            \
+static void name(uint32_t *input, const uint8_t *in, uint8_t *out, size_t blocks) { \
+    while (blocks--) {                                                        \
+        uint32_t x[16];                                                       \
+        block(input, x);                                                      \
+        for (int i = 0; i < 16; i++) {                                        \
+            u32tou8(&out[i*4], u8tou32(&in[i*4]) ^ x[i]);                     \
+        }                                                                     \
+        in += 64;                                                             \
+        out += 64;                                                            \
+    }                                                                         \
+}
+
+SCALAR_BLOCKS(chacha12_blocks, chacha12_block)
+SCALAR_BLOCKS(chacha8_blocks,  chacha8_block)
+
+void xchacha12_init(xChaCha_ctx *ctx, const uint8_t *k, const uint8_t *iv){
+    init(ctx, k, iv, doRounds12);
+}
+
+void xchacha12_encrypt_bytes(xChaCha_ctx *ctx, const uint8_t *m, uint8_t *c, uint32_t bytes){
+    crypt(ctx, m, c, bytes, chacha12_block, chacha12_blocks);
+}
+
+void xchacha8_init(xChaCha_ctx *ctx, const uint8_t *k, const uint8_t *iv){
+    init(ctx, k, iv, doRounds8);
+}
+
+void xchacha8_encrypt_bytes(xChaCha_ctx *ctx, const uint8_t *m, uint8_t *c, uint32_t bytes){
+    crypt(ctx, m, c, bytes, chacha8_block, chacha8_blocks);
 }
 
 void xchacha_decrypt_bytes(xChaCha_ctx *ctx, const uint8_t *c, uint8_t *m, uint32_t bytes){
     xchacha_encrypt_bytes(ctx,c,m,bytes);
 }
 
+void xchacha_encrypt(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len){
+    crypt(ctx, in, out, len, chacha_block, xc_blocks);
+}
+
+uint64_t xchacha_encrypt_iov(xChaCha_ctx *ctx, const xchacha_iovec *in, size_t in_count,
+                             const xchacha_iovec *out, size_t out_count){
+    size_t i = 0, o = 0, ip = 0, op = 0;    // segment index and position in it
+    uint64_t total = 0;
+    while ((i < in_count) && (o < out_count)) {
+        size_t n = in[i].len - ip;
+        if (n > out[o].len - op) n = out[o].len - op;
+        crypt(ctx, (const uint8_t *)in[i].base + ip, (uint8_t *)out[o].base + op, n,
+              chacha_block, xc_blocks);
+        total += n;
+        ip += n;  op += n;
+        if (ip == in[i].len)  { i++;  ip = 0; }
+        if (op == out[o].len) { o++;  op = 0; }
+    }
+    return total;
+}
+
+// Sectors n..n+k are one contiguous keystream range, so one bulk call does them all
+int xchacha_crypt_sectors(const xChaCha_ctx *ctx, uint64_t first_sector, size_t sector_size,
+                          size_t nsectors, const uint8_t *in, uint8_t *out){
+    uint64_t per = sector_size / 64;
+    uint32_t input[16];
+    if ((sector_size == 0) || (sector_size & 63)
+     || (first_sector > UINT64_MAX / per)
+     || (nsectors > (UINT64_MAX - first_sector * per) / per)) {
+        return -1;
+    }
+    memcpy(input, ctx->input, 64);
+    input[12] = input[13] = 0;
+    xc_counter_add(input, first_sector * per);
+    XC_STAT(bytes, nsectors * sector_size);
+    xc_blocks(input, in, out, nsectors * per);
+    memset(input, 0, 64);
+    return 0;
+}
+
 /* ------------------------------------------------------------------------- */
 
 // A more AES/SM4-like API abstraction
 
 void xc_crypt_init(xChaCha_ctx *ctx, const uint8_t *key, const uint8_t *iv) {
-    uint8_t nonce[24];
-    memset(nonce, 0, 24);
-    memcpy(nonce, iv, 16); // use 128 bits of the possible 192
-    xchacha_init(ctx, key, nonce);
+    uint8_t k2[32];         // use 128 bits of the possible 192, the rest are 0
+    XC_STAT(inits, 1);
+    hchacha(k2, iv, key, doRounds);
+    xc_ctx_setup(ctx, k2, 0, 0);
 }
 void xc_crypt_init_g(size_t *ctx, const uint8_t *key, const uint8_t *iv) {
     xc_crypt_init((void *)ctx, key, iv);
@@ -132,3 +442,20 @@ void xc_crypt_block(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out, int mode)
 void xc_crypt_block_g(size_t *ctx, const uint8_t *in, uint8_t *out, int mode) {
     xc_crypt_block((void *)ctx, in, out, mode);
 }
+
+void xc_crypt_blocks(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out, size_t nblocks, int mode) {
+    ctx->blox += (uint8_t)nblocks;
+    crypt(ctx, in, out, nblocks * 16, chacha_block, xc_blocks);
+}
+
+static void cipher_init(void *ctx, const uint8_t *key, const uint8_t *iv) {
+    xc_crypt_init(ctx, key, iv);
+}
+
+static void cipher_blocks(void *ctx, const uint8_t *in, uint8_t *out, size_t nblocks, int mode) {
+    xc_crypt_blocks(ctx, in, out, nblocks, mode);
+}
+
+const xc_cipher xc_cipher_xchacha = {
+    "xchacha20", sizeof(xChaCha_ctx), 16, 32, 16, cipher_init, cipher_blocks
+};
@@ -5,6 +5,7 @@
  * xChaCha version: https://github.com/spcnvdr/xChaCha
  * This version: https://github.com/bradleyeckert/ychacha
  */
+#include <stddef.h>
 #include <stdint.h>
 
 #ifndef _YCHACHA_H_
@@ -56,11 +57,419 @@ void xc_crypt_init_g   (size_t *ctx, const uint8_t *key, const uint8_t *iv);
 void xc_crypt_block(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out, int mode);
 void xc_crypt_block_g   (size_t *ctx, const uint8_t *in, uint8_t *out, int mode);
 
+/** Bulk version of xc_crypt_block, same result as nblocks single calls
+ * @param nblocks   Number of 16-byte blocks
+ */
+void xc_crypt_blocks(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out, size_t nblocks, int mode);
+
+#define XC_ENCRYPT 0            // mode values, ignored by stream ciphers
+#define XC_DECRYPT 1
+
+/** Cipher descriptor, so code written against the generic API can swap in
+ *  AES or SM4 and still reach each cipher's bulk path.
+ *  Allocate ctx_size bytes, suitably aligned, for a context.
+ */
+typedef struct
+{   const char *name;
+    size_t ctx_size;        // bytes for a context
+    int block_size;         // bytes per block of crypt_blocks
+    int key_size;           // bytes
+    int iv_size;            // bytes
+    void (*init)(void *ctx, const uint8_t *key, const uint8_t *iv);
+    void (*crypt_blocks)(void *ctx, const uint8_t *in, uint8_t *out, size_t nblocks, int mode);
+} xc_cipher;
+
+extern const xc_cipher xc_cipher_xchacha;
+
 // Classic functions for testing
 void xchacha_hchacha20(uint8_t *out, const uint8_t *in, const uint8_t *k);
-void xchacha_init(xChaCha_ctx *ctx, const uint8_t *k, uint8_t *iv);
+void xchacha_init(xChaCha_ctx *ctx, const uint8_t *k, const uint8_t *iv);
 void xchacha_set_counter(xChaCha_ctx *ctx, uint8_t *counter);
+
+/** Random access to the keystream
+ * The block counter becomes byte_offset / 64 and only the block containing
+ * byte_offset is regenerated, so a range read costs O(range).
+ * Offsets cover the first 2^58 blocks of the 2^64-block counter space.
+ * @param ctx           Encryption/Decryption context
+ * @param byte_offset   Keystream position of the next byte to use
+ */
+void xchacha_seek(xChaCha_ctx *ctx, uint64_t byte_offset);
+uint64_t xchacha_tell(const xChaCha_ctx *ctx);
+
 void xchacha_encrypt_bytes(xChaCha_ctx *ctx, const uint8_t *m, uint8_t *c, uint32_t bytes);
 void xchacha_decrypt_bytes(xChaCha_ctx *ctx, const uint8_t *c, uint8_t *m, uint32_t bytes);
 
+/** Same as xchacha_encrypt_bytes with a size_t length. in may equal out. */
+void xchacha_encrypt(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len);
+
+/** One segment of a scatter-gather list, laid out like struct iovec */
+typedef struct
+{   void *base;
+    size_t len;
+} xchacha_iovec;
+
+/** Scatter-gather encryption/decryption.
+ * Walks the input and output lists together, one keystream position running
+ * across all segment boundaries, so the result is the same as encrypting the
+ * concatenated input into the concatenated output. The segment boundaries of
+ * the two lists need not line up. Whole blocks inside a segment take the SIMD
+ * path. In place works when both lists describe the same memory in the same
+ * order (passing the same list twice is the usual way); other overlap does not.
+ * @param ctx       Encryption/Decryption context
+ * @param in        Input segments, not written
+ * @param out       Output segments
+ * @return          Bytes processed, the smaller of the two list totals
+ */
+uint64_t xchacha_encrypt_iov(xChaCha_ctx *ctx, const xchacha_iovec *in, size_t in_count,
+                             const xchacha_iovec *out, size_t out_count);
+
+/** Encrypt/decrypt and checksum the ciphertext in the same pass.
+ * Same output as xchacha_encrypt; the return value is the CRC32C of the
+ * ciphertext (out when encrypting, in when decrypting) continued from crc.
+ * Start with crc = 0 and chain calls to checksum a stream. in may equal out.
+ */
+uint32_t xchacha_encrypt_crc32c(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out,
+                                size_t len, uint32_t crc);
+uint32_t xchacha_decrypt_crc32c(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out,
+                                size_t len, uint32_t crc);
+
+/** CRC32C (Castagnoli) of a buffer, continued from crc, 0 to start.
+ *  SSE4.2 when available, else table driven. */
+uint32_t xc_crc32c(uint32_t crc, const uint8_t *p, size_t len);
+
+/** Sector-addressed encryption/decryption for block storage.
+ * Sector n is the keystream from byte n * sector_size, so the sectors of one
+ * call form a single range and go through the widest kernel in one pass.
+ * ctx only supplies the key and nonce and is not changed; in may equal out.
+ * @param ctx           Context from xchacha_init
+ * @param first_sector  Number of the sector at in/out
+ * @param sector_size   Bytes per sector, a multiple of 64
+ * @param nsectors      Consecutive sectors to process
+ * @return              0, or -1 on a bad sector size or counter overflow
+ */
+int xchacha_crypt_sectors(const xChaCha_ctx *ctx, uint64_t first_sector, size_t sector_size,
+                          size_t nsectors, const uint8_t *in, uint8_t *out);
+
+/** Reduced-round XChaCha12 and XChaCha8, for non-critical keystream only.
+ *  HChaCha and the block function both use the reduced round count.
+ *  A context set up by one of these inits must only be used with the
+ *  matching encrypt function. xchacha_tell works, but reposition with
+ *  xchacha_set_counter since xchacha_seek refills chabuf with 20 rounds.
+ *  Portable C, no SIMD.
+ */
+void xchacha12_init(xChaCha_ctx *ctx, const uint8_t *k, const uint8_t *iv);
+void xchacha12_encrypt_bytes(xChaCha_ctx *ctx, const uint8_t *m, uint8_t *c, uint32_t bytes);
+void xchacha8_init(xChaCha_ctx *ctx, const uint8_t *k, const uint8_t *iv);
+void xchacha8_encrypt_bytes(xChaCha_ctx *ctx, const uint8_t *m, uint8_t *c, uint32_t bytes);
+
+/** Multithreaded encryption of a large buffer
+ * The whole blocks are split into counter-aligned chunks that run on a pool
+ * of persistent worker threads. ctx ends up exactly as if the data had gone
+ * through xchacha_encrypt_bytes. Small buffers stay on the calling thread.
+ * @param ctx       Encryption/Decryption context
+ * @param in        Input data
+ * @param out       Output data, may equal in
+ * @param len       Length in bytes
+ * @param nthreads  Threads to use including the caller, <= 0 for all CPUs
+ */
+void xchacha_encrypt_parallel(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out,
+                              size_t len, int nthreads);
+
+/** Stop and join the worker threads. The next parallel call restarts them. */
+void xchacha_parallel_shutdown(void);
+
+/** One message of a batch */
+typedef struct
+{   const uint8_t *key;     // 32 bytes
+    const uint8_t *nonce;   // 24 bytes
+    const uint8_t *in;
+    uint8_t *out;           // may equal in
+    size_t len;
+} xchacha_msg;
+
+/** Encrypt/decrypt many independent messages, each from keystream position 0.
+ *  Same result as xchacha_init and xchacha_encrypt_bytes per message, but
+ *  HChaCha20, and the keystream of messages up to 64 bytes, run across SIMD
+ *  lanes, one message per lane; longer messages use the multi-block kernels.
+ */
+void xchacha_encrypt_batch(const xchacha_msg *msgs, size_t count);
+
+/** Random numbers from a ChaCha20 keystream with fast key erasure.
+ *  State is per thread and seeds itself from the OS on first use (and again
+ *  in a forked child); the process aborts if no entropy source is found.
+ *  Every refill rekeys before any output leaves, so a captured state reveals
+ *  nothing already returned.
+ */
+void xchacha_random_bytes(void *out, size_t len);
+uint32_t xchacha_random_u32(void);
+uint64_t xchacha_random_u64(void);
+
+/** Reseed the calling thread's generator with a 32-byte seed.
+ *  Also gives a repeatable stream for tests, or a seed where there is no OS RNG.
+ */
+void xchacha_random_seed(const uint8_t *seed);
+
+/** Compact session, 48 bytes against about 130 for xChaCha_ctx.
+ *  Holds the HChaCha20 subkey, nonce bytes 16..23 and the keystream byte
+ *  position; the block state and keystream buffer are rebuilt on the stack
+ *  for each call, which costs at most one extra block when pos is mid-block.
+ */
+typedef struct
+{   uint32_t key[8];        // subkey
+    uint32_t nonce[2];      // last 8 nonce bytes
+    uint64_t pos;           // keystream byte position
+} xchacha_session;
+
+void xchacha_session_init(xchacha_session *s, const uint8_t *key, const uint8_t *nonce);
+void xchacha_session_encrypt(xchacha_session *s, const uint8_t *in, uint8_t *out, size_t len);
+
+/** Convert between the compact and the working form */
+void xchacha_session_expand(const xchacha_session *s, xChaCha_ctx *ctx);
+void xchacha_session_compact(xchacha_session *s, const xChaCha_ctx *ctx);
+
+/** Fixed-capacity pool of sessions in one 64-byte aligned array.
+ *  Handles are array indices and slots[h] is the session. Fresh handles are
+ *  handed out from the low end and freed ones are reused first, so the live
+ *  sessions stay packed and a pass in handle order walks memory forward.
+ */
+#define XC_ARENA_NONE 0xFFFFFFFFu
+
+typedef struct
+{   xchacha_session *slots;
+    uint32_t capacity;
+    uint32_t used;          // slots ever handed out
+    uint32_t count;         // slots in use now
+    uint32_t free;          // first free slot, XC_ARENA_NONE if none
+} xchacha_arena;
+
+/** @return 0, or -1 on a bad capacity or out of memory */
+int xchacha_arena_init(xchacha_arena *a, uint32_t capacity);
+
+/** @return a zeroed slot's handle, XC_ARENA_NONE when the arena is full */
+uint32_t xchacha_arena_alloc(xchacha_arena *a);
+
+/** Wipe a slot and return it to the pool
+ * @return 0, or -1 if h was never handed out or is already free
+ */
+int xchacha_arena_free(xchacha_arena *a, uint32_t h);
+void xchacha_arena_destroy(xchacha_arena *a);
+
+/** Keystream ring: blocks computed ahead of use for one context, so that
+ *  encrypting in a latency-critical path is only an XOR. Fill it with
+ *  xchacha_prefetch when the CPU is idle, or let xchacha_ring_start run a
+ *  helper thread that keeps it full; use one of the two, not both. When the
+ *  ring runs dry xchacha_ring_encrypt computes the keystream itself.
+ *  Output is identical to xchacha_encrypt on a copy of the starting ctx.
+ */
+typedef struct
+{   xChaCha_ctx ctx;        // consumer position, counter = base + rpos
+    uint32_t base[16];      // state of ring block 0
+    uint8_t *ks;            // blocks x 64 bytes of keystream
+    size_t blocks;          // ring size, a power of two
+    uint64_t rpos;          // blocks used, written by the consumer only
+    uint64_t wpos;          // blocks made, written by the producer only
+    uint64_t wiped;         // producer only: slots of earlier blocks are clean
+    void *helper;           // background thread, if started
+    int stop;
+} xchacha_ring;
+
+/** Set up a ring that continues from ctx's keystream position
+ * @param blocks    Ring size in 64-byte blocks, a power of two
+ * @return          0, or -1 on a bad size or out of memory
+ */
+int xchacha_ring_init(xchacha_ring *r, const xChaCha_ctx *ctx, size_t blocks);
+
+/** Compute keystream ahead until at least nbytes (capped by the ring size)
+ *  are ready. @return bytes ready in the ring */
+size_t xchacha_prefetch(xchacha_ring *r, size_t nbytes);
+
+/** Encrypt/decrypt with the ring's keystream. in may equal out. */
+void xchacha_ring_encrypt(xchacha_ring *r, const uint8_t *in, uint8_t *out, size_t len);
+
+/** Start a helper thread that keeps the ring full
+ * @return  0, or -1 if threads are not available
+ */
+int xchacha_ring_start(xchacha_ring *r);
+
+/** Stop the helper, wipe and free the ring */
+void xchacha_ring_free(xchacha_ring *r);
+
+/** HChaCha20 of one key with n nonces, run across SIMD lanes
+ * @param out   n subkeys, 32 bytes each
+ * @param in    n nonces, 16 bytes each
+ * @param k     Key, 32 bytes
+ */
+void xchacha_hchacha20_multi(uint8_t *out, const uint8_t *in, const uint8_t *k, size_t n);
+
+/** xchacha_init of n contexts under one key, subkeys derived across lanes
+ * @param iv    n nonces, 24 bytes each
+ */
+void xchacha_init_multi(xChaCha_ctx *ctx, const uint8_t *k, const uint8_t *iv, size_t n);
+
+/** Bounded, thread-safe cache of HChaCha20 subkeys for workloads that rekey
+ *  often under the same long-term keys with recurring nonce prefixes.
+ *  Entries are matched on a secret-keyed 128-bit fingerprint of the key and
+ *  nonce bytes 0..15. Each set has its own spin lock, so lookups in
+ *  different sets never wait on each other and no OS threads API is needed.
+ *  The cache holds subkeys, so treat it as key material.
+ */
+typedef struct
+{   void *sets;             // 4-way sets, each with a spin lock
+    uint8_t secret[48];     // SipHash keys for fingerprints and set index
+    size_t mask;            // sets - 1
+    uint64_t hits, misses;
+} xchacha_subkey_cache;
+
+/** A key prepared for one cache: its fingerprint, computed once, and a copy
+ *  of the key for deriving subkeys on a miss. Wipe it when the key retires.
+ */
+typedef struct
+{   uint64_t fp[2];
+    uint8_t key[32];
+} xchacha_key_handle;
+
+/** @return 0, or -1 if out of memory. entries is rounded up to a power of two. */
+int xchacha_subkey_cache_init(xchacha_subkey_cache *c, size_t entries);
+void xchacha_subkey_cache_free(xchacha_subkey_cache *c);
+
+/** Fingerprint a 32-byte key for use with cache c */
+void xchacha_cache_key(const xchacha_subkey_cache *c, const uint8_t *key, xchacha_key_handle *h);
+
+/** Same result as xchacha_init(ctx, h->key, iv), with HChaCha20 skipped on a
+ *  cache hit. A lookup costs one SipHash of the nonce prefix.
+ */
+void xchacha_init_cached(xchacha_subkey_cache *c, const xchacha_key_handle *h,
+                         xChaCha_ctx *ctx, const uint8_t *iv);
+
+/* ------------------------------------------------------------------------- */
+
+/** Poly1305 one-time authenticator state.
+ *  Limbs are 44-bit (3 used) on 64-bit hosts and 26-bit (5 used) otherwise.
+ */
+typedef struct
+{   uint64_t r[5];          // clamped key r
+    uint64_t h[5];          // accumulator
+    uint64_t pad[2];        // key s
+    uint8_t buf[16];        // partial block
+    uint32_t left;          // bytes in buf
+} xc_poly1305_ctx;
+
+void xc_poly1305_init(xc_poly1305_ctx *ctx, const uint8_t *key);
+void xc_poly1305_update(xc_poly1305_ctx *ctx, const uint8_t *m, size_t bytes);
+void xc_poly1305_final(xc_poly1305_ctx *ctx, uint8_t *mac);
+
+/** XChaCha20-Poly1305 AEAD, draft-arciszewski-xchacha-03
+ *  Key is 32 bytes, nonce 24 bytes, tag 16 bytes.
+ */
+typedef struct
+{   xChaCha_ctx chacha;
+    xc_poly1305_ctx poly;
+    uint64_t aad_len;
+    uint64_t ct_len;
+} xchacha_aead_ctx;
+
+/** Incremental AEAD. All AAD must be supplied before the first data call.
+ *  Encrypt and decrypt updates may run in place (in == out).
+ *  xchacha_aead_verify returns 0 if the tag matches, -1 if not; the caller
+ *  must then discard everything the decrypt updates produced.
+ */
+void xchacha_aead_init(xchacha_aead_ctx *ctx, const uint8_t *key, const uint8_t *nonce);
+void xchacha_aead_aad(xchacha_aead_ctx *ctx, const uint8_t *aad, size_t len);
+void xchacha_aead_encrypt_update(xchacha_aead_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len);
+void xchacha_aead_decrypt_update(xchacha_aead_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len);
+void xchacha_aead_final(xchacha_aead_ctx *ctx, uint8_t *tag);
+int  xchacha_aead_verify(xchacha_aead_ctx *ctx, const uint8_t *tag);
+
+/** One-shot AEAD with a detached tag
+ * @return xchacha_aead_open: 0 if authentic, else -1 with out zeroed
+ */
+void xchacha_aead_seal(const uint8_t *key, const uint8_t *nonce,
+                       const uint8_t *aad, size_t aadlen,
+                       const uint8_t *in, uint8_t *out, size_t len, uint8_t *tag);
+int  xchacha_aead_open(const uint8_t *key, const uint8_t *nonce,
+                       const uint8_t *aad, size_t aadlen,
+                       const uint8_t *in, uint8_t *out, size_t len, const uint8_t *tag);
+
+/* ------------------------------------------------------------------------- */
+
+/** SipHash-2-4 keyed hash, for hash tables that must resist flooding.
+ * @param key   16 bytes
+ * @return      64-bit hash, the reference output read as little-endian
+ */
+uint64_t xc_siphash(const uint8_t *key, const uint8_t *m, size_t len);
+
+/** HalfSipHash-2-4 with 32-bit output, cheaper on 32-bit targets
+ * @param key   8 bytes
+ */
+uint32_t xc_halfsiphash(const uint8_t *key, const uint8_t *m, size_t len);
+
+/** SipHash-2-4 of count messages under one key, out[i] = xc_siphash(key,
+ *  m[i], len[i]). Runs 8 or 4 messages per SIMD group with AVX-512 or AVX2;
+ *  works best when lengths in a group are similar.
+ */
+void xc_siphash_batch(const uint8_t *key, const uint8_t *const *m, const size_t *len,
+                      uint64_t *out, size_t count);
+
+/* ------------------------------------------------------------------------- */
+
+/** Multi-block keystream kernels. The widest one the CPU supports is picked
+ *  at first use; the portable scalar core is always available, and the
+ *  vector-extension kernel is built by GCC or Clang for any target with SIMD.
+ */
+enum xc_kernels {
+    XC_KERNEL_SCALAR,       // portable C, 1 block
+    XC_KERNEL_VEC,          // GCC/Clang vector extensions (NEON, RVV...), 4 blocks
+    XC_KERNEL_SSE2,         // x86 SSE2, 4 blocks
+    XC_KERNEL_AVX2,         // x86 AVX2, 8 blocks
+    XC_KERNEL_AVX512,       // x86 AVX-512F, 16 blocks
+    XC_KERNELS
+};
+
+/** Currently selected kernel */
+int xchacha_kernel(void);
+
+/** Force a kernel, mostly for testing and benchmarking
+ * @param id    One of xc_kernels
+ * @return      0 if selected, -1 if not built or not supported by this CPU
+ */
+int xchacha_kernel_select(int id);
+
+/** Printable kernel name, "" if id is out of range */
+const char *xchacha_kernel_name(int id);
+
+/* ------------------------------------------------------------------------- */
+
+/** Hot-path statistics, compiled in with -DXCHACHA_STATS (GCC/Clang, C11).
+ *  -DXCHACHA_STATS_CYCLES also fills the cycle histograms; bucket i counts
+ *  calls that took [2^i, 2^(i+1)) TSC cycles, or nanoseconds off x86.
+ *  Without the flags the hot paths carry no counting code at all and the
+ *  functions below return -1.
+ */
+#define XC_STATS_BUCKETS 32
+
+typedef struct
+{   uint64_t inits;                 // contexts keyed, batch messages included
+    uint64_t hchacha;               // HChaCha20 subkey derivations
+    uint64_t blocks[XC_KERNELS];    // keystream blocks made, by kernel
+    uint64_t bytes;                 // keystream bytes used
+    uint64_t wasted;                // blocks*64 - bytes: skipped, dropped or still buffered
+    int kernel;                     // selected kernel at snapshot time
+    uint64_t init_cycles[XC_STATS_BUCKETS];     // xchacha_init
+    uint64_t encrypt_cycles[XC_STATS_BUCKETS];  // xchacha_encrypt_bytes
+} xchacha_stats;
+
+/** Copy the counters of the calling thread, or the sum over every thread
+ *  that has used the library (exited threads included) if all_threads.
+ * @return  0, or -1 if stats are not built in
+ */
+int xchacha_stats_snapshot(xchacha_stats *s, int all_threads);
+
+/** Zero the calling thread's counters */
+void xchacha_stats_reset(void);
+
+/** Format a snapshot as one JSON object, snprintf style
+ * @return  length of the full text, or -1 if stats are not built in
+ */
+int xchacha_stats_json(const xchacha_stats *s, char *buf, size_t size);
+
 #endif // _YCHACHA_H_
@@ -0,0 +1,115 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * XChaCha20-Poly1305 AEAD per draft-arciszewski-xchacha-03.
+ * The subkey comes from xchacha_hchacha20 via xchacha_init, block 0 of the
+ * keystream is the Poly1305 key and the payload starts at block 1.
+ * Data is processed in chunks small enough to stay in L1, so each chunk is
+ * encrypted and authenticated while it is still in cache.
+ */
+
+#include <string.h>
+#include "xchacha.h"
+
+#define CHUNK 1024                      // bytes encrypted then MACed at a time
+
+static const uint8_t zeros[16];
+
+static void mac_pad16(xc_poly1305_ctx *poly, uint64_t len) {
+    if (len & 15) xc_poly1305_update(poly, zeros, 16 - (size_t)(len & 15));
+}
+
+static void mac_u64(xc_poly1305_ctx *poly, uint64_t v) {
+    uint8_t b[8];
+    for (int i = 0; i < 8; i++) b[i] = (uint8_t)(v >> (i * 8));
+    xc_poly1305_update(poly, b, 8);
+}
+
+void xchacha_aead_init(xchacha_aead_ctx *ctx, const uint8_t *key, const uint8_t *nonce) {
+    uint8_t block0[64];
+    memset(block0, 0, 64);
+    xchacha_init(&ctx->chacha, key, nonce);
+    xchacha_encrypt_bytes(&ctx->chacha, block0, block0, 64);
+    xc_poly1305_init(&ctx->poly, block0);   // counter is now 1
+    memset(block0, 0, 64);
+    ctx->aad_len = 0;
+    ctx->ct_len = 0;
+}
+
+void xchacha_aead_aad(xchacha_aead_ctx *ctx, const uint8_t *aad, size_t len) {
+    xc_poly1305_update(&ctx->poly, aad, len);
+    ctx->aad_len += len;
+}
+
+static void start_data(xchacha_aead_ctx *ctx) {
+    if (ctx->ct_len == 0) mac_pad16(&ctx->poly, ctx->aad_len);
+}
+
+void xchacha_aead_encrypt_update(xchacha_aead_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len) {
+    if (!len) return;
+    start_data(ctx);
+    while (len) {
+        size_t n = (len < CHUNK) ? len : CHUNK;
+        xchacha_encrypt_bytes(&ctx->chacha, in, out, (uint32_t)n);
+        xc_poly1305_update(&ctx->poly, out, n);
+        ctx->ct_len += n;
+        in += n;  out += n;  len -= n;
+    }
+}
+
+void xchacha_aead_decrypt_update(xchacha_aead_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len) {
+    if (!len) return;
+    start_data(ctx);
+    while (len) {
+        size_t n = (len < CHUNK) ? len : CHUNK;
+        xc_poly1305_update(&ctx->poly, in, n);  // MAC before in-place decrypt
+        xchacha_encrypt_bytes(&ctx->chacha, in, out, (uint32_t)n);
+        ctx->ct_len += n;
+        in += n;  out += n;  len -= n;
+    }
+}
+
+void xchacha_aead_final(xchacha_aead_ctx *ctx, uint8_t *tag) {
+    if (ctx->ct_len == 0) mac_pad16(&ctx->poly, ctx->aad_len);
+    mac_pad16(&ctx->poly, ctx->ct_len);
+    mac_u64(&ctx->poly, ctx->aad_len);
+    mac_u64(&ctx->poly, ctx->ct_len);
+    xc_poly1305_final(&ctx->poly, tag);
+    memset(&ctx->chacha, 0, sizeof(ctx->chacha));
+}
+
+int xchacha_aead_verify(xchacha_aead_ctx *ctx, const uint8_t *tag) {
+    uint8_t mac[16];
+    uint8_t diff = 0;
+    xchacha_aead_final(ctx, mac);
+    for (int i = 0; i < 16; i++) {      // constant time compare
+        diff |= mac[i] ^ tag[i];
+    }
+    memset(mac, 0, 16);
+    return diff ? -1 : 0;
+}
+
+/* ------------------------------------------------------------------------- */
+
+void xchacha_aead_seal(const uint8_t *key, const uint8_t *nonce,
+                       const uint8_t *aad, size_t aadlen,
+                       const uint8_t *in, uint8_t *out, size_t len, uint8_t *tag) {
+    xchacha_aead_ctx ctx;
+    xchacha_aead_init(&ctx, key, nonce);
+    xchacha_aead_aad(&ctx, aad, aadlen);
+    xchacha_aead_encrypt_update(&ctx, in, out, len);
+    xchacha_aead_final(&ctx, tag);
+}
+
+int xchacha_aead_open(const uint8_t *key, const uint8_t *nonce,
+                      const uint8_t *aad, size_t aadlen,
+                      const uint8_t *in, uint8_t *out, size_t len, const uint8_t *tag) {
+    xchacha_aead_ctx ctx;
+    xchacha_aead_init(&ctx, key, nonce);
+    xchacha_aead_aad(&ctx, aad, aadlen);
+    xchacha_aead_decrypt_update(&ctx, in, out, len);
+    if (xchacha_aead_verify(&ctx, tag)) {
+        memset(out, 0, len);            // don't release unauthenticated data
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,170 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * Many independent messages in one call, one message per SIMD lane.
+ * HChaCha20 of every message in a group runs side by side, then keystream
+ * block k of every message up to 1.5 KiB, pass after pass, while at least half
+ * the lanes still have a block k. Whatever is left, and longer messages,
+ * go through the multi-block kernels.
+ */
+
+#include <string.h>
+#include "xchacha.h"
+#include "xchacha_internal.h"
+
+#define MAX_LANES 16
+#define LANE_LIMIT 1536                 // longer messages skip the lane passes
+
+static const uint32_t sigma[4] = {
+    0x61707865, 0x3320646e, 0x79622d32, 0x6b206574
+};
+
+static void encrypt_group(const xchacha_msg *msg, int w) {
+    uint32_t s[16 * MAX_LANES], j[16 * MAX_LANES], input[16];
+    uint8_t ks[64], scratch[LANE_LIMIT + 64];
+    uint64_t k;
+    int i, l, kern, lane[MAX_LANES];
+
+    for (l = 0; l < w; l++) {           // HChaCha20 of each key and nonce
+        for (i = 0; i < 4; i++) {
+            s[i*w + l]        = sigma[i];
+            s[(i + 4)*w + l]  = xc_load32(&msg[l].key[i*4]);
+            s[(i + 8)*w + l]  = xc_load32(&msg[l].key[i*4 + 16]);
+            s[(i + 12)*w + l] = xc_load32(&msg[l].nonce[i*4]);
+        }
+        XC_STAT(bytes, msg[l].len);
+    }
+    xc_rounds_lanes(s, w);
+    XC_STAT(inits, w);
+    XC_STAT(hchacha, w);
+
+    for (l = 0; l < w; l++) {           // block 0 state under each subkey
+        for (i = 0; i < 4; i++) {
+            j[i*w + l]       = sigma[i];
+            j[(i + 4)*w + l] = s[i*w + l];
+            j[(i + 8)*w + l] = s[(i + 12)*w + l];
+        }
+        j[14*w + l] = xc_load32(&msg[l].nonce[16]);
+        j[15*w + l] = xc_load32(&msg[l].nonce[20]);
+    }
+
+    // Block k of every message per pass, while at least half the lanes have one.
+    // Past LANE_LIMIT the kernels' own transposes beat the per-lane stores.
+    for (l = 0; l < w; l++) lane[l] = (w > 1) && (msg[l].len <= LANE_LIMIT);
+    for (k = 0; ; k++) {
+        int active = 0;
+        for (l = 0; l < w; l++) active += lane[l] && (msg[l].len > k * 64);
+        if (!active || (active * 2 < w)) break;
+        for (l = 0; l < w; l++) {
+            j[12*w + l] = (uint32_t)k;
+            j[13*w + l] = (uint32_t)(k >> 32);
+        }
+        memcpy(s, j, sizeof(uint32_t) * 16 * w);
+        kern = xc_rounds_lanes(s, w);
+        XC_STAT(blocks[kern], active);
+        (void)kern;
+        for (l = 0; l < w; l++) {
+            const uint8_t *in = msg[l].in + k * 64;
+            uint8_t *out = msg[l].out + k * 64;
+            size_t n;
+            if (!lane[l] || (msg[l].len <= k * 64)) continue;
+            n = msg[l].len - k * 64;
+            if (n >= 64) {
+                for (i = 0; i < 16; i++) {
+                    xc_store32(&out[i*4], xc_load32(&in[i*4]) ^ (s[i*w + l] + j[i*w + l]));
+                }
+            } else {                    // final partial block
+                for (i = 0; i < 16; i++) xc_store32(&ks[i*4], s[i*w + l] + j[i*w + l]);
+                for (i = 0; i < (int)n; i++) out[i] = in[i] ^ ks[i];
+            }
+        }
+    }
+
+    for (l = 0; l < w; l++) {           // longer messages finish on the kernels
+        const uint8_t *in = msg[l].in;
+        uint8_t *out = msg[l].out;
+        size_t len = msg[l].len, ofs = lane[l] ? (size_t)k * 64 : 0, n;
+        if (len <= ofs) continue;
+        for (i = 0; i < 16; i++) input[i] = j[i*w + l];
+        input[12] = (uint32_t)(ofs / 64);
+        input[13] = (uint32_t)((uint64_t)(ofs / 64) >> 32);
+        if ((len & 63) && (len - ofs <= LANE_LIMIT)) {     // one call, tail included
+            xc_blocks(input, 0, scratch, (len - ofs + 63) / 64);
+            for (n = 0; n < len - ofs; n++) out[ofs + n] = in[ofs + n] ^ scratch[n];
+            memset(scratch, 0, (len - ofs + 63) & ~(size_t)63);
+            continue;
+        }
+        xc_blocks(input, &in[ofs], &out[ofs], (len - ofs) / 64);
+        if (len & 63) {                 // final partial block
+            ofs = len & ~(size_t)63;
+            xc_blocks(input, 0, ks, 1);
+            for (n = 0; n < (len & 63); n++) out[ofs + n] = in[ofs + n] ^ ks[n];
+        }
+    }
+    memset(s, 0, sizeof(s));
+    memset(j, 0, sizeof(j));
+    memset(input, 0, sizeof(input));
+    memset(ks, 0, sizeof(ks));
+}
+
+void xchacha_encrypt_batch(const xchacha_msg *msgs, size_t count) {
+    int width = xc_lanes();
+    while (count) {
+        int w = width;
+        while ((size_t)w > count) w >>= 1;
+        encrypt_group(msgs, w);
+        msgs += w;
+        count -= w;
+    }
+}
+
+/* ------------------------------------------------------------------------- */
+
+// HChaCha20 of one key with w nonces, `stride` bytes apart, across lanes
+static void hchacha_group(uint8_t *out, const uint8_t *in, size_t stride,
+                          const uint8_t *k, int w) {
+    uint32_t s[16 * MAX_LANES];
+    int i, l;
+    for (i = 0; i < 12; i++) {          // constants and key, same in every lane
+        uint32_t v = (i < 4) ? sigma[i] : xc_load32(&k[(i - 4) * 4]);
+        for (l = 0; l < w; l++) s[i*w + l] = v;
+    }
+    for (l = 0; l < w; l++) {
+        for (i = 0; i < 4; i++) s[(i + 12)*w + l] = xc_load32(&in[l*stride + i*4]);
+    }
+    xc_rounds_lanes(s, w);
+    XC_STAT(hchacha, w);
+    for (l = 0; l < w; l++) {
+        for (i = 0; i < 4; i++) {
+            xc_store32(&out[l*32 + i*4], s[i*w + l]);
+            xc_store32(&out[l*32 + 16 + i*4], s[(i + 12)*w + l]);
+        }
+    }
+    memset(s, 0, sizeof(s));
+}
+
+void xchacha_hchacha20_multi(uint8_t *out, const uint8_t *in, const uint8_t *k, size_t n) {
+    int width = xc_lanes();
+    while (n) {
+        int w = width;
+        while ((size_t)w > n) w >>= 1;
+        hchacha_group(out, in, 16, k, w);
+        out += 32 * w;  in += 16 * w;  n -= w;
+    }
+}
+
+void xchacha_init_multi(xChaCha_ctx *ctx, const uint8_t *k, const uint8_t *iv, size_t n) {
+    uint8_t sub[32 * MAX_LANES];
+    int width = xc_lanes(), l;
+    while (n) {
+        int w = width;
+        while ((size_t)w > n) w >>= 1;
+        hchacha_group(sub, iv, 24, k, w);
+        for (l = 0; l < w; l++) {
+            xc_ctx_setup(&ctx[l], &sub[l*32], xc_load32(&iv[l*24 + 16]),
+                         xc_load32(&iv[l*24 + 20]));
+        }
+        XC_STAT(inits, w);
+        ctx += w;  iv += 24 * w;  n -= w;
+    }
+    memset(sub, 0, sizeof(sub));
+}
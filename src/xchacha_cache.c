@@ -0,0 +1,101 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * Bounded cache of HChaCha20 subkeys, 4-way set associative.
+ * An entry is found by a 128-bit fingerprint of the key, SipHash under a
+ * per-cache random secret and computed once per key handle, plus nonce
+ * bytes 0..15. The set comes from a SipHash of the nonce mixed with the
+ * fingerprint, so chosen nonces cannot be aimed at one set. Each set has a
+ * spin lock held only to compare or copy an entry; replacement is round
+ * robin within the set.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "xchacha.h"
+#include "xchacha_internal.h"
+
+#define WAYS    4
+
+typedef struct {
+    uint64_t fp[2];
+    uint8_t nonce[16];
+    uint8_t subkey[32];
+    int valid;
+} entry;
+
+typedef struct {
+    entry way[WAYS];
+    unsigned next;                      // next victim
+    int lock;
+} set;
+
+static void lock(set *s) {
+    while (__atomic_exchange_n(&s->lock, 1, __ATOMIC_ACQUIRE)) {
+        while (__atomic_load_n(&s->lock, __ATOMIC_RELAXED)) { }
+    }
+}
+
+static void unlock(set *s) {
+    __atomic_store_n(&s->lock, 0, __ATOMIC_RELEASE);
+}
+
+int xchacha_subkey_cache_init(xchacha_subkey_cache *c, size_t entries) {
+    size_t sets = 1;
+    memset(c, 0, sizeof(*c));
+    while (sets * WAYS < entries) sets <<= 1;
+    if ((c->sets = calloc(sets, sizeof(set))) == NULL) return -1;
+    c->mask = sets - 1;
+    xchacha_random_bytes(c->secret, sizeof(c->secret));
+    return 0;
+}
+
+void xchacha_subkey_cache_free(xchacha_subkey_cache *c) {
+    if (c->sets) {
+        memset(c->sets, 0, (c->mask + 1) * sizeof(set));
+        free(c->sets);
+    }
+    memset(c, 0, sizeof(*c));
+}
+
+void xchacha_cache_key(const xchacha_subkey_cache *c, const uint8_t *key, xchacha_key_handle *h) {
+    h->fp[0] = xc_siphash(c->secret, key, 32);
+    h->fp[1] = xc_siphash(&c->secret[16], key, 32);
+    memcpy(h->key, key, 32);
+}
+
+void xchacha_init_cached(xchacha_subkey_cache *c, const xchacha_key_handle *h,
+                         xChaCha_ctx *ctx, const uint8_t *iv) {
+    size_t i = (size_t)((xc_siphash(&c->secret[32], iv, 16) ^ h->fp[0]) & c->mask);
+    set *s = &((set *)c->sets)[i];
+    uint8_t sub[32];
+    int w;
+
+    lock(s);
+    for (w = 0; w < WAYS; w++) {
+        entry *e = &s->way[w];
+        if (e->valid && (e->fp[0] == h->fp[0]) && (e->fp[1] == h->fp[1])
+         && !memcmp(e->nonce, iv, 16)) {
+            memcpy(sub, e->subkey, 32);
+            break;
+        }
+    }
+    unlock(s);
+    if (w < WAYS) {
+        __atomic_fetch_add(&c->hits, 1, __ATOMIC_RELAXED);
+    } else {                            // derive outside the lock, then insert
+        entry *e;
+        __atomic_fetch_add(&c->misses, 1, __ATOMIC_RELAXED);
+        xchacha_hchacha20(sub, iv, h->key);
+        lock(s);
+        e = &s->way[s->next++ % WAYS];
+        e->fp[0] = h->fp[0];
+        e->fp[1] = h->fp[1];
+        memcpy(e->nonce, iv, 16);
+        memcpy(e->subkey, sub, 32);
+        e->valid = 1;
+        unlock(s);
+    }
+    XC_STAT(inits, 1);
+    xc_ctx_setup(ctx, sub, xc_load32(&iv[16]), xc_load32(&iv[20]));
+    memset(sub, 0, 32);
+}
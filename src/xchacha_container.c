@@ -0,0 +1,189 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * Chunked XChaCha20 container for data at rest, readable at random offsets.
+ *
+ *   header   64 bytes, see below
+ *   chunks   chunk i holds plaintext bytes [i*chunk_size, (i+1)*chunk_size)
+ *            encrypted from block counter i * (chunk_size / 64)
+ *   index    one 16-byte entry per chunk: file offset (8), length (4), 0 (4)
+ *
+ * Header: "XCC1", version (2), header size (2), chunk size (4), chunk count
+ * (4), plaintext size (8), index offset (8), nonce (24), zero (8).
+ * All integers are little-endian. Chunk counters come from the container
+ * nonce, so a reader keys one context and only seeks per chunk.
+ * Chunks are not authenticated; wrap the container in a MAC if needed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "xchacha_container.h"
+
+#define XCC_VERSION 1
+#define XCC_HEADER  64
+#define XCC_ENTRY   16
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)v;  p[1] = (uint8_t)(v >> 8);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    for (int i = 0; i < 4; i++) p[i] = (uint8_t)(v >> (i * 8));
+}
+
+static void put64(uint8_t *p, uint64_t v) {
+    for (int i = 0; i < 8; i++) p[i] = (uint8_t)(v >> (i * 8));
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return ((uint32_t)p[0]) | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static uint64_t get64(const uint8_t *p) {
+    return get32(p) | ((uint64_t)get32(&p[4]) << 32);
+}
+
+static void make_header(uint8_t *h, uint32_t chunk_size, uint32_t chunks,
+                        uint64_t size, uint64_t index, const uint8_t *nonce) {
+    memset(h, 0, XCC_HEADER);
+    memcpy(h, "XCC1", 4);
+    put16(&h[4], XCC_VERSION);
+    put16(&h[6], XCC_HEADER);
+    put32(&h[8], chunk_size);
+    put32(&h[12], chunks);
+    put64(&h[16], size);
+    put64(&h[24], index);
+    memcpy(&h[32], nonce, 24);
+}
+
+/* ------------------------------------------------------------------------- */
+
+int xcc_writer_open(xcc_writer *w, FILE *f, const uint8_t *key,
+                    const uint8_t *nonce, uint32_t chunk_size) {
+    uint8_t h[XCC_HEADER];
+    if ((chunk_size == 0) || (chunk_size & 63)) return -1;
+    memset(w, 0, sizeof(*w));
+    w->file = f;
+    w->chunk_size = chunk_size;
+    memcpy(w->nonce, nonce, 24);
+    xchacha_init(&w->ctx, key, nonce);
+    make_header(h, chunk_size, 0, 0, 0, nonce);  // rewritten by close
+    return (fwrite(h, 1, XCC_HEADER, f) == XCC_HEADER) ? 0 : -1;
+}
+
+int xcc_writer_write(xcc_writer *w, const uint8_t *data, size_t len) {
+    uint8_t buf[4096];
+    while (len) {
+        size_t n = (len < sizeof(buf)) ? len : sizeof(buf);
+        xchacha_encrypt_bytes(&w->ctx, data, buf, (uint32_t)n);
+        if (fwrite(buf, 1, n, w->file) != n) return -1;
+        w->size += n;
+        data += n;  len -= n;
+    }
+    return 0;
+}
+
+int xcc_writer_close(xcc_writer *w) {
+    uint64_t index = XCC_HEADER + w->size;
+    uint64_t chunks = (w->size + w->chunk_size - 1) / w->chunk_size;
+    uint8_t h[XCC_HEADER], e[XCC_ENTRY];
+    int result = 0;
+    if (chunks > 0xFFFFFFFFu) return -1;
+    for (uint64_t i = 0; i < chunks; i++) {      // trailing index
+        uint64_t ofs = i * w->chunk_size;
+        uint64_t len = w->size - ofs;
+        if (len > w->chunk_size) len = w->chunk_size;
+        memset(e, 0, XCC_ENTRY);
+        put64(&e[0], XCC_HEADER + ofs);
+        put32(&e[8], (uint32_t)len);
+        if (fwrite(e, 1, XCC_ENTRY, w->file) != XCC_ENTRY) result = -1;
+    }
+    make_header(h, w->chunk_size, (uint32_t)chunks, w->size, index, w->nonce);
+    if (fseek(w->file, 0, SEEK_SET)
+     || (fwrite(h, 1, XCC_HEADER, w->file) != XCC_HEADER)
+     || fflush(w->file)) {
+        result = -1;
+    }
+    memset(&w->ctx, 0, sizeof(w->ctx));
+    return result;
+}
+
+/* ------------------------------------------------------------------------- */
+
+int xcc_open(xcc_reader *r, FILE *f, const uint8_t *key) {
+    struct stat st;
+    const uint8_t *h;
+    uint64_t i, expect;
+    memset(r, 0, sizeof(*r));
+    if (fflush(f) || fstat(fileno(f), &st) || (st.st_size < XCC_HEADER)) return -1;
+    r->map_size = (size_t)st.st_size;
+    r->map = mmap(0, r->map_size, PROT_READ, MAP_SHARED, fileno(f), 0);
+    if (r->map == MAP_FAILED) {
+        r->map = 0;
+        return -1;
+    }
+    h = r->map;
+    r->chunk_size = get32(&h[8]);
+    r->chunks = get32(&h[12]);
+    r->size = get64(&h[16]);
+    r->index = get64(&h[24]);
+    if (memcmp(h, "XCC1", 4) || (get32(&h[4]) != (XCC_VERSION | (XCC_HEADER << 16)))
+     || (r->chunk_size == 0) || (r->chunk_size & 63)
+     || (r->size > (uint64_t)r->chunks * r->chunk_size)     // 32x32 bits, no wrap
+     || (r->chunks && (r->size <= (uint64_t)(r->chunks - 1) * r->chunk_size))
+     || (r->index > r->map_size)
+     || ((r->map_size - r->index) / XCC_ENTRY < r->chunks)) {
+        goto bad;
+    }
+    for (i = 0; i < r->chunks; i++) {   // every chunk must lie inside the file
+        const uint8_t *e = &r->map[r->index + i * XCC_ENTRY];
+        uint64_t ofs = get64(e);
+        uint32_t len = get32(&e[8]);
+        expect = r->size - i * r->chunk_size;
+        if (expect > r->chunk_size) expect = r->chunk_size;
+        if ((len != expect) || (ofs > r->map_size) || (len > r->map_size - ofs)) goto bad;
+    }
+    xchacha_init(&r->ctx, key, &h[32]);
+    return 0;
+bad:
+    xcc_close(r);
+    return -1;
+}
+
+int xcc_read(xcc_reader *r, uint64_t offset, uint8_t *out, size_t len, int nthreads) {
+    xChaCha_ctx ctx;
+    int result = 0;
+    if ((offset > r->size) || (len > r->size - offset)) {
+        len = 0;
+        result = -1;
+    }
+    while (len) {
+        uint64_t chunk = offset / r->chunk_size;
+        uint64_t within = offset % r->chunk_size;
+        const uint8_t *e = &r->map[r->index + chunk * XCC_ENTRY];
+        uint64_t start = get64(e) + within;
+        size_t n = get32(&e[8]) - (size_t)within;
+        // Chunks are contiguous in the keystream; extend the run while they
+        // are also contiguous in the file, so one parallel call covers it
+        while ((n < len) && (++chunk < r->chunks)) {
+            e += XCC_ENTRY;
+            if (get64(e) != start + n) break;
+            n += get32(&e[8]);
+        }
+        if (n > len) n = len;
+        ctx = r->ctx;                   // already keyed, only seek per run
+        xchacha_seek(&ctx, offset);
+        xchacha_encrypt_parallel(&ctx, &r->map[start], out, n, nthreads);
+        out += n;  offset += n;  len -= n;
+    }
+    memset(&ctx, 0, sizeof(ctx));       // keyed state does not outlive the call
+    return result;
+}
+
+void xcc_close(xcc_reader *r) {
+    if (r->map) munmap((void *)r->map, r->map_size);
+    memset(r, 0, sizeof(*r));
+}
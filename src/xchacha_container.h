@@ -0,0 +1,52 @@
+/*
+ * Chunked XChaCha20 container with a trailing index, for encrypted data at
+ * rest that must be readable at arbitrary offsets. POSIX only (uses mmap).
+ * The file layout is described in xchacha_container.c.
+ */
+#include <stdio.h>
+#include "xchacha.h"
+
+#ifndef _XCHACHA_CONTAINER_H_
+#define _XCHACHA_CONTAINER_H_
+
+typedef struct
+{   FILE *file;
+    xChaCha_ctx ctx;        // running keystream
+    uint8_t nonce[24];
+    uint32_t chunk_size;
+    uint64_t size;          // plaintext bytes written so far
+} xcc_writer;
+
+typedef struct
+{   const uint8_t *map;     // whole file, read-only mapping
+    size_t map_size;
+    xChaCha_ctx ctx;        // keyed once, copied and seeked per chunk
+    uint32_t chunk_size;
+    uint32_t chunks;
+    uint64_t size;          // plaintext size
+    uint64_t index;         // file offset of the index
+} xcc_reader;
+
+/** Write a container to a seekable stream
+ * @param chunk_size  Plaintext bytes per chunk, a multiple of 64
+ * @return 0 on success, -1 on error. xcc_writer_close does not close f.
+ */
+int xcc_writer_open(xcc_writer *w, FILE *f, const uint8_t *key,
+                    const uint8_t *nonce, uint32_t chunk_size);
+int xcc_writer_write(xcc_writer *w, const uint8_t *data, size_t len);
+int xcc_writer_close(xcc_writer *w);
+
+/** Map a container and check its header and index
+ * @return 0 on success, -1 if f is not a valid container
+ */
+int xcc_open(xcc_reader *r, FILE *f, const uint8_t *key);
+
+/** Decrypt plaintext bytes [offset, offset+len), touching only the chunks
+ *  that overlap the range
+ * @param nthreads  as for xchacha_encrypt_parallel, 1 for the calling thread
+ * @return 0 on success, -1 if the range is outside the plaintext
+ */
+int xcc_read(xcc_reader *r, uint64_t offset, uint8_t *out, size_t len, int nthreads);
+void xcc_close(xcc_reader *r);
+
+#endif // _XCHACHA_CONTAINER_H_
@@ -0,0 +1,115 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * Encryption fused with a CRC32C (Castagnoli) of the ciphertext.
+ * The data is handled in 1 KiB pieces: the kernel writes a piece to its
+ * destination and the checksum reads it back while it is still in L1, so
+ * memory sees each byte once instead of once per pass.
+ * CRC32C uses the SSE4.2 instruction when the CPU has it, else slicing-by-8.
+ */
+
+#include <string.h>
+#include "xchacha.h"
+#include "xchacha_internal.h"
+
+#define PIECE 1024                      // bytes per fused step
+
+static uint32_t table[8][256];
+static int table_ready;
+
+static void make_table(void) {
+    for (int i = 0; i < 256; i++) {
+        uint32_t c = (uint32_t)i;
+        for (int k = 0; k < 8; k++) c = (c >> 1) ^ (0x82F63B78u & (0u - (c & 1)));
+        table[0][i] = c;
+    }
+    for (int i = 0; i < 256; i++) {
+        for (int t = 1; t < 8; t++) {
+            table[t][i] = (table[t-1][i] >> 8) ^ table[0][table[t-1][i] & 0xFF];
+        }
+    }
+}
+
+static uint32_t crc_sw(uint32_t c, const uint8_t *p, size_t len) {
+    while (len >= 8) {
+        uint32_t lo = c ^ xc_load32(p), hi = xc_load32(&p[4]);
+        c = table[7][lo & 0xFF] ^ table[6][(lo >> 8) & 0xFF]
+          ^ table[5][(lo >> 16) & 0xFF] ^ table[4][lo >> 24]
+          ^ table[3][hi & 0xFF] ^ table[2][(hi >> 8) & 0xFF]
+          ^ table[1][(hi >> 16) & 0xFF] ^ table[0][hi >> 24];
+        p += 8;  len -= 8;
+    }
+    while (len--) c = (c >> 8) ^ table[0][(c ^ *p++) & 0xFF];
+    return c;
+}
+
+#ifdef XC_X86_KERNELS
+#include <immintrin.h>
+
+__attribute__((target("sse4.2")))
+static uint32_t crc_hw(uint32_t c, const uint8_t *p, size_t len) {
+#if defined(__x86_64__)
+    uint64_t c64 = c;
+    for (; len >= 8; p += 8, len -= 8) {
+        uint64_t w;
+        memcpy(&w, p, 8);
+        c64 = _mm_crc32_u64(c64, w);
+    }
+    c = (uint32_t)c64;
+#endif
+    for (; len >= 4; p += 4, len -= 4) {
+        uint32_t w;
+        memcpy(&w, p, 4);
+        c = _mm_crc32_u32(c, w);
+    }
+    while (len--) c = _mm_crc32_u8(c, *p++);
+    return c;
+}
+#endif
+
+typedef uint32_t (*crc_fn)(uint32_t c, const uint8_t *p, size_t len);
+
+// Pick an implementation, building the table once under a spin lock if needed
+static crc_fn crc_impl(void) {
+#ifdef XC_X86_KERNELS
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) return crc_hw;
+#endif
+    if (!__atomic_load_n(&table_ready, __ATOMIC_ACQUIRE)) {
+        static int busy;
+        while (__atomic_exchange_n(&busy, 1, __ATOMIC_ACQUIRE)) { }
+        if (!table_ready) make_table();
+        __atomic_store_n(&table_ready, 1, __ATOMIC_RELEASE);
+        __atomic_store_n(&busy, 0, __ATOMIC_RELEASE);
+    }
+    return crc_sw;
+}
+
+uint32_t xc_crc32c(uint32_t crc, const uint8_t *p, size_t len) {
+    return ~crc_impl()(~crc, p, len);
+}
+
+static uint32_t fused(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out, size_t len,
+                      uint32_t crc, int decrypt) {
+    crc_fn f = crc_impl();
+    size_t n = PIECE - (size_t)(xchacha_tell(ctx) & 63);  // later pieces block aligned
+    crc = ~crc;
+    while (len) {
+        if (n > len) n = len;
+        if (decrypt) crc = f(crc, in, n);               // ciphertext is the input
+        xchacha_encrypt(ctx, in, out, n);
+        if (!decrypt) crc = f(crc, out, n);
+        in += n;  out += n;  len -= n;
+        n = PIECE;
+    }
+    return ~crc;
+}
+
+uint32_t xchacha_encrypt_crc32c(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out,
+                                size_t len, uint32_t crc) {
+    return fused(ctx, in, out, len, crc, 0);
+}
+
+uint32_t xchacha_decrypt_crc32c(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out,
+                                size_t len, uint32_t crc) {
+    return fused(ctx, in, out, len, crc, 1);
+}
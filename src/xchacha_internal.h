@@ -0,0 +1,149 @@
+/*
+ * Internal interfaces shared by the xChaCha source files.
+ * Not part of the public API.
+ */
+#include <stddef.h>
+#include <stdint.h>
+#include "xchacha.h"
+
+#ifndef _XCHACHA_INTERNAL_H_
+#define _XCHACHA_INTERNAL_H_
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define XC_X86_KERNELS 1            /* SSE2/AVX2/AVX-512 kernels are built */
+#endif
+
+#if defined(__GNUC__) && (defined(__ARM_NEON) || defined(__ARM_FEATURE_MVE)          \
+    || defined(__riscv_vector) || defined(__SSE2__) || defined(__ALTIVEC__)           \
+    || defined(__wasm_simd128__))
+#define XC_VEC_KERNEL 1             /* vector_size kernel is built, target has SIMD */
+#endif
+
+/** Multi-block keystream kernel.
+ * Processes as many whole groups of the kernel's width as fit in `blocks`,
+ * XORing `in` into `out`, or storing raw keystream when `in` is NULL.
+ * The 64-bit block counter in input[12..13] is advanced accordingly.
+ * @returns number of 64-byte blocks processed
+ */
+typedef size_t (*xc_kernel_fn)(uint32_t *input, const uint8_t *in, uint8_t *out, size_t blocks);
+
+#ifdef XC_VEC_KERNEL
+size_t xc_blocks_vec(uint32_t *input, const uint8_t *in, uint8_t *out, size_t blocks);
+void xc_rounds_x4_vec(uint32_t *s);
+#endif
+
+#ifdef XC_X86_KERNELS
+size_t xc_blocks_sse2  (uint32_t *input, const uint8_t *in, uint8_t *out, size_t blocks);
+size_t xc_blocks_avx2  (uint32_t *input, const uint8_t *in, uint8_t *out, size_t blocks);
+size_t xc_blocks_avx512(uint32_t *input, const uint8_t *in, uint8_t *out, size_t blocks);
+void xc_rounds_x4_sse2   (uint32_t *s);
+void xc_rounds_x8_avx2   (uint32_t *s);
+void xc_rounds_x16_avx512(uint32_t *s);
+void xc_siphash_x4_avx2  (const uint64_t *k, const uint8_t *const *m, const size_t *len, uint64_t *out);
+void xc_siphash_x8_avx512(const uint64_t *k, const uint8_t *const *m, const size_t *len, uint64_t *out);
+#endif
+
+/** ChaCha quarter round and double round on 16 words x[0..15] of any type.
+ * P is a prefix naming the kernel's P_ADD, P_XOR and P_R16/R12/R8/R7
+ * (rotate left) macros, so every multi-block kernel shares one round.
+ */
+#define XC_QR(P, a, b, c, d)                                                  \
+    a = P##_ADD(a, b);  d = P##_R16(P##_XOR(d, a));                           \
+    c = P##_ADD(c, d);  b = P##_R12(P##_XOR(b, c));                           \
+    a = P##_ADD(a, b);  d = P##_R8 (P##_XOR(d, a));                           \
+    c = P##_ADD(c, d);  b = P##_R7 (P##_XOR(b, c));
+
+#define XC_DOUBLEROUND(P, x)                                                  \
+    XC_QR(P, x[0], x[4], x[ 8], x[12])  XC_QR(P, x[1], x[5], x[ 9], x[13])    \
+    XC_QR(P, x[2], x[6], x[10], x[14])  XC_QR(P, x[3], x[7], x[11], x[15])    \
+    XC_QR(P, x[0], x[5], x[10], x[15])  XC_QR(P, x[1], x[6], x[11], x[12])    \
+    XC_QR(P, x[2], x[7], x[ 8], x[13])  XC_QR(P, x[3], x[4], x[ 9], x[14])
+
+/** Little-endian 32-bit load and store, any alignment */
+static inline uint32_t xc_load32(const uint8_t *p) {
+    return ((uint32_t)p[0]) | ((uint32_t)p[1] << 8) |
+           ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+static inline void xc_store32(uint8_t *p, uint32_t v) {
+    p[0] = (uint8_t)v;          p[1] = (uint8_t)(v >> 8);
+    p[2] = (uint8_t)(v >> 16);  p[3] = (uint8_t)(v >> 24);
+}
+
+/** Word b of a SipHash message, b <= len / 8. The last word holds the tail
+ * bytes and the length in its top byte.
+ */
+static inline uint64_t xc_sip_word(const uint8_t *m, size_t len, size_t b) {
+    size_t i, n = len - b * 8;
+    uint64_t w = 0;
+    if (n >= 8) return xc_load32(&m[b*8]) | ((uint64_t)xc_load32(&m[b*8 + 4]) << 32);
+    for (i = 0; i < n; i++) w |= (uint64_t)m[b*8 + i] << (i * 8);
+    return w | ((uint64_t)len << 56);
+}
+
+/** Advance the 64-bit block counter in input[12..13] */
+static inline void xc_counter_add(uint32_t *input, uint64_t n) {
+    uint64_t c = (((uint64_t)input[13] << 32) | input[12]) + n;
+    input[12] = (uint32_t)c;
+    input[13] = (uint32_t)(c >> 32);
+}
+
+/** Keystream for `blocks` whole blocks using the selected kernel, then
+ * narrower kernels, then the scalar core for whatever is left over.
+ */
+void xc_blocks(uint32_t *input, const uint8_t *in, uint8_t *out, size_t blocks);
+
+/** Fill ctx for keystream position 0 from a 32-byte HChaCha20 subkey and
+ * nonce words 4 and 5 (bytes 16..23)
+ */
+void xc_ctx_setup(xChaCha_ctx *ctx, const uint8_t *subkey, uint32_t n0, uint32_t n1);
+
+/** Lane count of the widest multi-state kernel, 1 if there is none */
+int xc_lanes(void);
+
+/** 20 ChaCha rounds, without feed-forward, on `lanes` independent states.
+ * Word i of state l is s[i*lanes + l]. Any lane count works; 4, 8 and 16
+ * use the matching SIMD kernel when it is available.
+ * @returns the xc_kernels id that did the work, for statistics
+ */
+int xc_rounds_lanes(uint32_t *s, int lanes);
+
+/* ------------------------------------------------------------------------- */
+
+#if defined(XCHACHA_STATS_CYCLES) && !defined(XCHACHA_STATS)
+#define XCHACHA_STATS 1
+#endif
+
+#ifdef XCHACHA_STATS
+
+/** Per-thread counters, linked into a list so snapshots can sum them */
+typedef struct xc_stats_slot {
+    xchacha_stats s;
+    struct xc_stats_slot *next;
+    int live;
+} xc_stats_slot;
+
+extern _Thread_local xc_stats_slot xc_stats;
+void xc_stats_register(xc_stats_slot *slot);
+
+/** Only the owning thread writes, so a relaxed store is enough for readers */
+static inline void xc_stat_add(uint64_t *field, uint64_t n) {
+    if (__builtin_expect(!xc_stats.live, 0)) xc_stats_register(&xc_stats);
+    __atomic_store_n(field, *field + n, __ATOMIC_RELAXED);
+}
+#define XC_STAT(field, n) xc_stat_add(&xc_stats.s.field, (n))
+#else
+#define XC_STAT(field, n) ((void)0)
+#endif
+
+#ifdef XCHACHA_STATS_CYCLES
+uint64_t xc_cycles(void);
+void xc_stats_time(uint64_t *hist, uint64_t cycles);
+#define XC_TIMER(t) uint64_t t = xc_cycles()
+#define XC_TIMED(t, hist) xc_stats_time(xc_stats.s.hist, xc_cycles() - (t))
+#else
+#define XC_TIMER(t)
+#define XC_TIMED(t, hist) ((void)0)
+#endif
+
+#endif // _XCHACHA_INTERNAL_H_
@@ -0,0 +1,174 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * Parallel encryption of large buffers. ChaCha blocks only depend on the
+ * counter, so the buffer is cut into counter-aligned chunks that a pool of
+ * persistent worker threads encrypts independently. The pool is created on
+ * first use and grows to the largest thread count asked for.
+ */
+
+#include <string.h>
+#include "xchacha.h"
+#include "xchacha_internal.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#define XC_THREADS 1
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+#define MAX_THREADS 64
+#define MIN_CHUNK   (64 * 1024)     // bytes per thread below which we don't split
+
+typedef struct {
+    uint32_t input[16];             // state with this chunk's first counter
+    const uint8_t *in;
+    uint8_t *out;
+    size_t blocks;
+} xc_job;
+
+#ifdef XC_THREADS
+
+static struct {
+    pthread_mutex_t lock;
+    pthread_cond_t work;            // jobs posted or shutdown
+    pthread_cond_t done;            // last pending job finished
+    pthread_mutex_t call;           // one parallel call at a time
+    pthread_t tid[MAX_THREADS];
+    int workers;
+    int stop;
+    xc_job *jobs;
+    int njobs, next, pending;
+} pool = {
+    PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER, PTHREAD_MUTEX_INITIALIZER
+};
+
+static void run_job(xc_job *job) {
+    xc_blocks(job->input, job->in, job->out, job->blocks);
+}
+
+// Take and run jobs until none are left. Called with pool.lock held.
+static void drain(void) {
+    while (pool.next < pool.njobs) {
+        xc_job *job = &pool.jobs[pool.next++];
+        pthread_mutex_unlock(&pool.lock);
+        run_job(job);
+        pthread_mutex_lock(&pool.lock);
+        if (--pool.pending == 0) {
+            pthread_cond_signal(&pool.done);
+        }
+    }
+}
+
+static void *worker(void *arg) {
+    (void)arg;
+    pthread_mutex_lock(&pool.lock);
+    while (!pool.stop) {
+        drain();
+        if (!pool.stop) pthread_cond_wait(&pool.work, &pool.lock);
+    }
+    pthread_mutex_unlock(&pool.lock);
+    return 0;
+}
+
+static int cpu_count(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n < 1) ? 1 : (int)n;
+}
+
+// Run njobs jobs on the caller plus up to njobs-1 pool threads
+static void run_jobs(xc_job *jobs, int njobs) {
+    pthread_mutex_lock(&pool.call);
+    pthread_mutex_lock(&pool.lock);
+    while ((pool.workers < njobs - 1) && !pool.stop) {
+        if (pthread_create(&pool.tid[pool.workers], 0, worker, 0)) break;
+        pool.workers++;
+    }
+    pool.jobs = jobs;
+    pool.njobs = njobs;
+    pool.next = 0;
+    pool.pending = njobs;
+    pthread_cond_broadcast(&pool.work);
+    drain();                        // the caller works too
+    while (pool.pending) {
+        pthread_cond_wait(&pool.done, &pool.lock);
+    }
+    pool.jobs = 0;
+    pool.njobs = pool.next = 0;
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool.call);
+}
+
+void xchacha_parallel_shutdown(void) {
+    pthread_mutex_lock(&pool.call);
+    pthread_mutex_lock(&pool.lock);
+    pool.stop = 1;
+    pthread_cond_broadcast(&pool.work);
+    pthread_mutex_unlock(&pool.lock);
+    for (int i = 0; i < pool.workers; i++) {
+        pthread_join(pool.tid[i], 0);
+    }
+    pthread_mutex_lock(&pool.lock);
+    pool.workers = 0;
+    pool.stop = 0;
+    pthread_mutex_unlock(&pool.lock);
+    pthread_mutex_unlock(&pool.call);
+}
+
+#else
+
+static int cpu_count(void) {
+    return 1;
+}
+
+static void run_jobs(xc_job *jobs, int njobs) {
+    for (int i = 0; i < njobs; i++) {
+        xc_blocks(jobs[i].input, jobs[i].in, jobs[i].out, jobs[i].blocks);
+    }
+}
+
+void xchacha_parallel_shutdown(void) {
+}
+
+#endif // XC_THREADS
+
+void xchacha_encrypt_parallel(xChaCha_ctx *ctx, const uint8_t *in, uint8_t *out,
+                              size_t len, int nthreads) {
+    xc_job jobs[MAX_THREADS];
+    size_t blocks, head = 0;
+    int i, n;
+
+    if (ctx->chaptr < 64) {         // leftover keystream from an earlier call
+        head = 64 - ctx->chaptr;
+        if (head > len) head = len;
+        xchacha_encrypt_bytes(ctx, in, out, (uint32_t)head);
+        in += head;  out += head;  len -= head;
+    }
+    blocks = len / 64;
+    if (nthreads <= 0) nthreads = cpu_count();
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+    n = (int)((blocks * 64) / MIN_CHUNK);
+    if (n > nthreads) n = nthreads;
+
+    xchacha_kernel();               // settle kernel choice before the threads start
+    XC_STAT(bytes, blocks * 64);
+    if (n < 2) {
+        xc_blocks(ctx->input, in, out, blocks);
+    } else {
+        size_t start = 0;
+        for (i = 0; i < n; i++) {   // counter-aligned chunks, the first ones larger
+            size_t count = blocks / n + ((size_t)i < blocks % n);
+            memcpy(jobs[i].input, ctx->input, 64);
+            xc_counter_add(jobs[i].input, start);
+            jobs[i].in = in + start * 64;
+            jobs[i].out = out + start * 64;
+            jobs[i].blocks = count;
+            start += count;
+        }
+        run_jobs(jobs, n);
+        xc_counter_add(ctx->input, blocks);
+    }
+    in += blocks * 64;
+    out += blocks * 64;
+    xchacha_encrypt_bytes(ctx, in, out, (uint32_t)(len & 63));
+}
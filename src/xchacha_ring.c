@@ -0,0 +1,183 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * Keystream computed ahead of time into a ring of blocks.
+ * One producer (xchacha_prefetch calls or the helper thread) and one
+ * consumer (xchacha_ring_encrypt). Block j of the keystream always lives in
+ * slot j % blocks, wpos and rpos only grow, and each side writes only its
+ * own index, so no locks are needed. When the ring runs dry the consumer
+ * computes the blocks itself and moves rpos past them; the producer then
+ * skips ahead to rpos, since any copy of block j is the same bytes, and
+ * wipes whatever it had published in the range the consumer skipped.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "xchacha.h"
+#include "xchacha_internal.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#include <time.h>
+#define XC_POSIX 1
+#endif
+
+#define LOAD(p)     __atomic_load_n(p, __ATOMIC_ACQUIRE)
+#define STORE(p, v) __atomic_store_n(p, v, __ATOMIC_RELEASE)
+
+int xchacha_ring_init(xchacha_ring *r, const xChaCha_ctx *ctx, size_t blocks) {
+    memset(r, 0, sizeof(*r));
+    if ((blocks == 0) || (blocks & (blocks - 1))) return -1;
+    if ((r->ks = malloc(blocks * 64)) == NULL) return -1;
+    r->ctx = *ctx;
+    memcpy(r->base, ctx->input, 64);
+    r->blocks = blocks;
+    return 0;
+}
+
+/* Producer: wipe the slots of blocks the consumer has passed without reading
+ * them, which happens when it ran dry while the producer was publishing.
+ * A block below rpos is never read again, and one at or above w - blocks
+ * shares its slot only with a block that is not published yet, so the
+ * consumer cannot be reading that slot.
+ */
+static void wipe_passed(xchacha_ring *r, uint64_t w, uint64_t rp) {
+    uint64_t p = r->wiped, end = (rp < w) ? rp : w;
+    if (w > r->blocks && p < w - r->blocks) p = w - r->blocks;
+    for (; p < end; p++) memset(&r->ks[((size_t)p & (r->blocks - 1)) * 64], 0, 64);
+    if (end > r->wiped) r->wiped = end;
+}
+
+// Producer: make up to `want` blocks ahead of the consumer
+static size_t produce(xchacha_ring *r, size_t want) {
+    uint64_t rp = LOAD(&r->rpos);
+    uint64_t w = __atomic_load_n(&r->wpos, __ATOMIC_RELAXED);
+    uint32_t input[16];
+    size_t n, done = 0;
+    wipe_passed(r, w, rp);
+    if (w < rp) w = rp;                 // consumer ran ahead, skip what it did
+    n = (size_t)(rp + r->blocks - w);
+    if (n > want) n = want;
+    memcpy(input, r->base, 64);
+    xc_counter_add(input, w);
+    while (n) {
+        size_t slot = (size_t)w & (r->blocks - 1);
+        size_t k = r->blocks - slot;
+        if (k > n) k = n;
+        xc_blocks(input, 0, &r->ks[slot * 64], k);
+        w += k;  n -= k;  done += k;
+        STORE(&r->wpos, w);
+    }
+    wipe_passed(r, w, LOAD(&r->rpos));
+    memset(input, 0, 64);
+    return done;
+}
+
+size_t xchacha_prefetch(xchacha_ring *r, size_t nbytes) {
+    uint64_t rp = LOAD(&r->rpos), w = LOAD(&r->wpos);
+    size_t want = (nbytes + 63) / 64, ready = (w > rp) ? (size_t)(w - rp) : 0;
+    if (want > ready) produce(r, want - ready);
+    rp = LOAD(&r->rpos);
+    w = LOAD(&r->wpos);
+    return (w > rp) ? (size_t)(w - rp) * 64 : 0;
+}
+
+static void xor_block(uint8_t *out, const uint8_t *in, uint8_t *ks) {
+    for (int i = 0; i < 64; i++) out[i] = in[i] ^ ks[i];
+    memset(ks, 0, 64);                  // used keystream does not linger
+}
+
+void xchacha_ring_encrypt(xchacha_ring *r, const uint8_t *in, uint8_t *out, size_t len) {
+    xChaCha_ctx *ctx = &r->ctx;         // counter is always base + rpos
+    uint64_t rp = r->rpos, w;
+    XC_STAT(bytes, len);
+    while (len && (ctx->chaptr < 64)) { // leftover keystream first
+        *out++ = *in++ ^ ctx->chabuf[ctx->chaptr++];
+        len--;
+    }
+    if (!len) return;
+    w = LOAD(&r->wpos);
+    while ((len >= 64) && (rp < w)) {   // precomputed whole blocks
+        xor_block(out, in, &r->ks[((size_t)rp & (r->blocks - 1)) * 64]);
+        in += 64;  out += 64;  len -= 64;
+        STORE(&r->rpos, ++rp);
+    }
+    if (len >= 64) {                    // ring is dry: compute directly
+        size_t k = len / 64;
+        memcpy(ctx->input, r->base, 64);
+        xc_counter_add(ctx->input, rp);
+        xc_blocks(ctx->input, in, out, k);
+        in += k * 64;  out += k * 64;  len &= 63;
+        STORE(&r->rpos, rp += k);
+    }
+    if (len) {                          // partial block goes through chabuf
+        if (rp < LOAD(&r->wpos)) {
+            uint8_t *ks = &r->ks[((size_t)rp & (r->blocks - 1)) * 64];
+            memcpy(ctx->chabuf, ks, 64);
+            memset(ks, 0, 64);
+        } else {
+            memcpy(ctx->input, r->base, 64);
+            xc_counter_add(ctx->input, rp);
+            xc_blocks(ctx->input, 0, ctx->chabuf, 1);
+        }
+        STORE(&r->rpos, ++rp);
+        ctx->chaptr = 0;
+        while (len--) *out++ = *in++ ^ ctx->chabuf[ctx->chaptr++];
+    }
+    memcpy(ctx->input, r->base, 64);
+    xc_counter_add(ctx->input, rp);
+}
+
+/* ------------------------------------------------------------------------- */
+
+#ifdef XC_POSIX
+
+static void *helper(void *arg) {
+    xchacha_ring *r = arg;
+    const struct timespec nap = { 0, 20000 };
+    while (!LOAD(&r->stop)) {
+        if (produce(r, r->blocks) == 0) nanosleep(&nap, 0);    // ring is full
+    }
+    return 0;
+}
+
+int xchacha_ring_start(xchacha_ring *r) {
+    pthread_t *t;
+    if (r->helper) return 0;
+    if ((t = malloc(sizeof(pthread_t))) == NULL) return -1;
+    STORE(&r->stop, 0);
+    if (pthread_create(t, 0, helper, r) != 0) {
+        free(t);
+        return -1;
+    }
+    r->helper = t;
+    return 0;
+}
+
+static void stop_helper(xchacha_ring *r) {
+    if (r->helper) {
+        STORE(&r->stop, 1);
+        pthread_join(*(pthread_t *)r->helper, 0);
+        free(r->helper);
+        r->helper = 0;
+    }
+}
+
+#else
+
+int xchacha_ring_start(xchacha_ring *r) {
+    (void)r;
+    return -1;
+}
+
+static void stop_helper(xchacha_ring *r) { (void)r; }
+
+#endif // XC_POSIX
+
+void xchacha_ring_free(xchacha_ring *r) {
+    stop_helper(r);
+    if (r->ks) {
+        memset(r->ks, 0, r->blocks * 64);
+        free(r->ks);
+    }
+    memset(r, 0, sizeof(*r));
+}
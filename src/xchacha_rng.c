@@ -0,0 +1,172 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * ChaCha20 random number generator with fast key erasure
+ * (https://blog.cr.yp.to/20170723-random.html).
+ * Each thread has its own state, so there are no locks. A refill runs the
+ * multi-block kernel over RNG_BLOCKS blocks, the first 32 bytes replace the
+ * key at once and the rest are handed out, wiped as they go. Past output
+ * therefore cannot be recovered from the current state.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "xchacha.h"
+#include "xchacha_internal.h"
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#if defined(__linux__)
+#include <sys/random.h>
+#endif
+#define XC_POSIX 1
+#endif
+
+#define RNG_BLOCKS 16                   // 1 KiB per refill
+
+typedef struct {
+    uint32_t input[16];                 // key in input[4..11], nonce 0
+    uint8_t buf[RNG_BLOCKS * 64];
+    size_t pos;                         // next unused byte of buf
+    unsigned gen;                       // fork generation when seeded
+    int seeded;
+} rng_state;
+
+static _Thread_local rng_state rng;
+
+#ifdef XC_POSIX
+
+static volatile unsigned fork_gen = 1;  // bumped in the child after fork()
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+
+static void on_fork(void) { fork_gen++; }
+static void register_fork(void) { pthread_atfork(0, 0, on_fork); }
+
+static int os_entropy(uint8_t *p, size_t len) {
+#if defined(__linux__)
+    while (len) {
+        ssize_t n = getrandom(p, len, 0);
+        if (n < 0) break;               // fall back to /dev/urandom
+        p += n;  len -= (size_t)n;
+    }
+    if (!len) return 0;
+#endif
+    int fd = open("/dev/urandom", O_RDONLY);
+    if (fd < 0) return -1;
+    while (len) {
+        ssize_t n = read(fd, p, len);
+        if (n <= 0) {
+            close(fd);
+            return -1;
+        }
+        p += n;  len -= (size_t)n;
+    }
+    close(fd);
+    return 0;
+}
+
+#else
+
+static const unsigned fork_gen = 1;
+
+static int os_entropy(uint8_t *p, size_t len) {
+    (void)p;  (void)len;
+    return -1;                          // call xchacha_random_seed first
+}
+
+#endif // XC_POSIX
+
+static void rekey(rng_state *r, const uint8_t *key) {
+    r->input[0] = 0x61707865;
+    r->input[1] = 0x3320646e;
+    r->input[2] = 0x79622d32;
+    r->input[3] = 0x6b206574;
+    for (int i = 0; i < 8; i++) r->input[i + 4] = xc_load32(&key[i*4]);
+    r->input[12] = r->input[13] = r->input[14] = r->input[15] = 0;
+}
+
+static void refill(rng_state *r) {
+    xc_blocks(r->input, 0, r->buf, RNG_BLOCKS);
+    rekey(r, r->buf);                   // first 32 bytes are the next key
+    memset(r->buf, 0, 32);
+    r->pos = 32;
+    XC_STAT(bytes, 32);
+}
+
+void xchacha_random_seed(const uint8_t *seed) {
+    rng_state *r = &rng;
+#ifdef XC_POSIX
+    pthread_once(&once, register_fork);
+#endif
+    rekey(r, seed);
+    memset(r->buf, 0, sizeof(r->buf));
+    r->pos = sizeof(r->buf);
+    r->gen = fork_gen;
+    r->seeded = 1;
+}
+
+static rng_state *state(void) {
+    rng_state *r = &rng;
+    if (!r->seeded || (r->gen != fork_gen)) {   // first use, or forked child
+        uint8_t seed[32];
+        if (os_entropy(seed, 32)) abort();
+        xchacha_random_seed(seed);
+        memset(seed, 0, 32);
+    }
+    return r;
+}
+
+void xchacha_random_bytes(void *out, size_t len) {
+    rng_state *r = state();
+    uint8_t *p = out;
+    if (len > sizeof(r->buf)) {         // large: straight from the kernel
+        uint8_t tmp[64];
+        uint32_t input[16];
+        memcpy(input, r->input, 64);
+        xc_blocks(input, 0, tmp, 1);
+        rekey(r, tmp);                  // old key gone before any output
+        xc_blocks(input, 0, p, len / 64);
+        if (len & 63) {
+            xc_blocks(input, 0, tmp, 1);
+            memcpy(&p[len & ~(size_t)63], tmp, len & 63);
+        }
+        memset(tmp, 0, 64);
+        memset(input, 0, 64);
+        XC_STAT(bytes, 32 + len);
+        return;
+    }
+    while (len) {
+        size_t n;
+        if (r->pos == sizeof(r->buf)) refill(r);
+        n = sizeof(r->buf) - r->pos;
+        if (n > len) n = len;
+        memcpy(p, &r->buf[r->pos], n);
+        memset(&r->buf[r->pos], 0, n);
+        r->pos += n;
+        p += n;  len -= n;
+        XC_STAT(bytes, n);
+    }
+}
+
+uint32_t xchacha_random_u32(void) {
+    rng_state *r = state();
+    uint32_t v;
+    if (sizeof(r->buf) - r->pos < 4) refill(r);
+    memcpy(&v, &r->buf[r->pos], 4);
+    memset(&r->buf[r->pos], 0, 4);
+    r->pos += 4;
+    XC_STAT(bytes, 4);
+    return v;
+}
+
+uint64_t xchacha_random_u64(void) {
+    rng_state *r = state();
+    uint64_t v;
+    if (sizeof(r->buf) - r->pos < 8) refill(r);
+    memcpy(&v, &r->buf[r->pos], 8);
+    memset(&r->buf[r->pos], 0, 8);
+    r->pos += 8;
+    XC_STAT(bytes, 8);
+    return v;
+}
@@ -0,0 +1,102 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * Compact 48-byte sessions and a fixed-size arena to keep them in.
+ * A session stores what cannot be rebuilt: the HChaCha20 subkey, the last
+ * 8 nonce bytes and the keystream position. A full xChaCha_ctx exists only
+ * on the stack for the duration of a call, and is wiped afterwards.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "xchacha.h"
+#include "xchacha_internal.h"
+
+void xchacha_session_init(xchacha_session *s, const uint8_t *key, const uint8_t *nonce) {
+    uint8_t k2[32];
+    XC_STAT(inits, 1);
+    xchacha_hchacha20(k2, nonce, key);
+    for (int i = 0; i < 8; i++) s->key[i] = xc_load32(&k2[i*4]);
+    s->nonce[0] = xc_load32(&nonce[16]);
+    s->nonce[1] = xc_load32(&nonce[20]);
+    s->pos = 0;
+    memset(k2, 0, 32);
+}
+
+void xchacha_session_expand(const xchacha_session *s, xChaCha_ctx *ctx) {
+    ctx->input[0] = 0x61707865;
+    ctx->input[1] = 0x3320646e;
+    ctx->input[2] = 0x79622d32;
+    ctx->input[3] = 0x6b206574;
+    memcpy(&ctx->input[4], s->key, 32);
+    ctx->input[14] = s->nonce[0];
+    ctx->input[15] = s->nonce[1];
+    ctx->blox = 0;
+    xchacha_seek(ctx, s->pos);
+}
+
+void xchacha_session_compact(xchacha_session *s, const xChaCha_ctx *ctx) {
+    memcpy(s->key, &ctx->input[4], 32);
+    s->nonce[0] = ctx->input[14];
+    s->nonce[1] = ctx->input[15];
+    s->pos = xchacha_tell(ctx);
+}
+
+void xchacha_session_encrypt(xchacha_session *s, const uint8_t *in, uint8_t *out, size_t len) {
+    xChaCha_ctx ctx;
+    xchacha_session_expand(s, &ctx);
+    xchacha_encrypt(&ctx, in, out, len);
+    s->pos += len;
+    memset(&ctx, 0, sizeof(ctx));
+}
+
+/* ------------------------------------------------------------------------- */
+
+// A free slot holds the handle of the next free slot in key[0] and FREED in
+// pos, which no live session reaches without first encrypting 2^64 bytes
+#define FREED UINT64_MAX
+
+int xchacha_arena_init(xchacha_arena *a, uint32_t capacity) {
+    size_t bytes;
+    memset(a, 0, sizeof(*a));
+    if ((capacity == 0) || (capacity == XC_ARENA_NONE)
+     || (capacity > (SIZE_MAX - 63) / sizeof(xchacha_session))) {  // 32-bit size_t
+        return -1;
+    }
+    bytes = ((size_t)capacity * sizeof(xchacha_session) + 63) & ~(size_t)63;
+    if ((a->slots = aligned_alloc(64, bytes)) == NULL) return -1;
+    a->capacity = capacity;
+    a->free = XC_ARENA_NONE;
+    return 0;
+}
+
+uint32_t xchacha_arena_alloc(xchacha_arena *a) {
+    uint32_t h = a->free;
+    if (h != XC_ARENA_NONE) {
+        a->free = a->slots[h].key[0];
+    } else if (a->used < a->capacity) {
+        h = a->used++;
+    } else {
+        return XC_ARENA_NONE;
+    }
+    memset(&a->slots[h], 0, sizeof(xchacha_session));
+    a->count++;
+    return h;
+}
+
+int xchacha_arena_free(xchacha_arena *a, uint32_t h) {
+    if ((h >= a->used) || (a->slots[h].pos == FREED)) return -1;
+    memset(&a->slots[h], 0, sizeof(xchacha_session));
+    a->slots[h].key[0] = a->free;
+    a->slots[h].pos = FREED;
+    a->free = h;
+    a->count--;
+    return 0;
+}
+
+void xchacha_arena_destroy(xchacha_arena *a) {
+    if (a->slots) {
+        memset(a->slots, 0, (size_t)a->capacity * sizeof(xchacha_session));
+        free(a->slots);
+    }
+    memset(a, 0, sizeof(*a));
+}
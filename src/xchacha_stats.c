@@ -0,0 +1,182 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * Optional hot-path statistics, see XCHACHA_STATS in xchacha.h.
+ * Each thread counts into its own slot. A slot joins a global list the
+ * first time it is touched and its totals move to `retired` when the
+ * thread exits, so all-thread snapshots never lose counts.
+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include "xchacha.h"
+#include "xchacha_internal.h"
+
+#ifdef XCHACHA_STATS
+
+#if defined(__unix__) || defined(__APPLE__)
+#include <pthread.h>
+#define XC_POSIX 1
+#endif
+
+_Thread_local xc_stats_slot xc_stats;
+
+#define N_COUNTERS (offsetof(xchacha_stats, kernel) / sizeof(uint64_t))
+#define N_HIST     (2 * XC_STATS_BUCKETS)
+
+// every uint64_t field of xchacha_stats, in order, skipping `kernel`
+static uint64_t *counter(xchacha_stats *s, int i) {
+    if (i < (int)N_COUNTERS) return &((uint64_t *)s)[i];
+    i -= N_COUNTERS;
+    return (i < XC_STATS_BUCKETS) ? &s->init_cycles[i]
+                                  : &s->encrypt_cycles[i - XC_STATS_BUCKETS];
+}
+
+static void add(xchacha_stats *sum, xchacha_stats *s) {
+    for (int i = 0; i < (int)(N_COUNTERS + N_HIST); i++) {
+        *counter(sum, i) += __atomic_load_n(counter(s, i), __ATOMIC_RELAXED);
+    }
+}
+
+#ifdef XC_POSIX
+
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t key;
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static xc_stats_slot *slots;            // live threads
+static xchacha_stats retired;           // threads that have exited
+
+static void unregister(void *p) {
+    xc_stats_slot *slot = p, **pp;
+    pthread_mutex_lock(&lock);
+    for (pp = &slots; *pp; pp = &(*pp)->next) {
+        if (*pp == slot) {
+            *pp = slot->next;
+            break;
+        }
+    }
+    add(&retired, &slot->s);
+    slot->live = 0;
+    pthread_mutex_unlock(&lock);
+}
+
+static void make_key(void) { pthread_key_create(&key, unregister); }
+
+void xc_stats_register(xc_stats_slot *slot) {
+    pthread_once(&once, make_key);
+    pthread_setspecific(key, slot);     // runs unregister at thread exit
+    pthread_mutex_lock(&lock);
+    slot->next = slots;
+    slots = slot;
+    slot->live = 1;
+    pthread_mutex_unlock(&lock);
+}
+
+#else
+
+void xc_stats_register(xc_stats_slot *slot) { slot->live = 1; }
+
+#endif // XC_POSIX
+
+int xchacha_stats_snapshot(xchacha_stats *s, int all_threads) {
+    memset(s, 0, sizeof(*s));
+#ifdef XC_POSIX
+    if (all_threads) {
+        pthread_mutex_lock(&lock);
+        add(s, &retired);
+        for (xc_stats_slot *p = slots; p; p = p->next) add(s, &p->s);
+        pthread_mutex_unlock(&lock);
+    } else
+#endif
+    add(s, &xc_stats.s);
+    s->wasted = 0;
+    for (int i = 0; i < XC_KERNELS; i++) s->wasted += s->blocks[i] * 64;
+    s->wasted = (s->wasted > s->bytes) ? s->wasted - s->bytes : 0;
+    s->kernel = xchacha_kernel();
+    return 0;
+}
+
+void xchacha_stats_reset(void) {
+    for (int i = 0; i < (int)(N_COUNTERS + N_HIST); i++) {
+        __atomic_store_n(counter(&xc_stats.s, i), 0, __ATOMIC_RELAXED);
+    }
+}
+
+#ifdef XCHACHA_STATS_CYCLES
+
+#if defined(__x86_64__) || defined(__i386__)
+uint64_t xc_cycles(void) { return __builtin_ia32_rdtsc(); }
+#else
+#include <time.h>
+uint64_t xc_cycles(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+#endif
+
+void xc_stats_time(uint64_t *hist, uint64_t cycles) {
+    int b = 63 - __builtin_clzll(cycles | 1);
+    if (b >= XC_STATS_BUCKETS) b = XC_STATS_BUCKETS - 1;
+    xc_stat_add(&hist[b], 1);
+}
+
+#endif // XCHACHA_STATS_CYCLES
+
+// append to buf like snprintf, counting the full length even when truncated
+static void put(char *buf, size_t size, size_t *len, const char *fmt, ...) {
+    va_list ap;
+    int n;
+    va_start(ap, fmt);
+    n = (*len < size) ? vsnprintf(buf + *len, size - *len, fmt, ap)
+                      : vsnprintf(0, 0, fmt, ap);
+    va_end(ap);
+    if (n > 0) *len += (size_t)n;
+}
+
+static void put_hist(char *buf, size_t size, size_t *len, const char *name,
+                     const uint64_t *h) {
+    int i, last = -1;
+    for (i = 0; i < XC_STATS_BUCKETS; i++) if (h[i]) last = i;
+    put(buf, size, len, ", \"%s\": [", name);
+    for (i = 0; i <= last; i++) {
+        put(buf, size, len, "%s%llu", i ? ", " : "", (unsigned long long)h[i]);
+    }
+    put(buf, size, len, "]");
+}
+
+int xchacha_stats_json(const xchacha_stats *s, char *buf, size_t size) {
+    size_t len = 0;
+    put(buf, size, &len, "{\"kernel\": \"%s\", \"inits\": %llu, \"hchacha\": %llu, "
+        "\"bytes\": %llu, \"wasted\": %llu, \"blocks\": {",
+        xchacha_kernel_name(s->kernel), (unsigned long long)s->inits,
+        (unsigned long long)s->hchacha, (unsigned long long)s->bytes,
+        (unsigned long long)s->wasted);
+    for (int i = 0; i < XC_KERNELS; i++) {
+        put(buf, size, &len, "%s\"%s\": %llu", i ? ", " : "",
+            xchacha_kernel_name(i), (unsigned long long)s->blocks[i]);
+    }
+    put(buf, size, &len, "}");
+    put_hist(buf, size, &len, "init_cycles", s->init_cycles);
+    put_hist(buf, size, &len, "encrypt_cycles", s->encrypt_cycles);
+    put(buf, size, &len, "}");
+    return (int)len;
+}
+
+#else
+
+int xchacha_stats_snapshot(xchacha_stats *s, int all_threads) {
+    (void)all_threads;
+    memset(s, 0, sizeof(*s));
+    return -1;
+}
+
+void xchacha_stats_reset(void) { }
+
+int xchacha_stats_json(const xchacha_stats *s, char *buf, size_t size) {
+    (void)s;
+    if (size) buf[0] = 0;
+    return -1;
+}
+
+#endif // XCHACHA_STATS
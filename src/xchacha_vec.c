@@ -0,0 +1,71 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * Portable 4-block ChaCha20 kernel written with GCC/Clang vector extensions.
+ * A 4 x 32-bit vector lowers to NEON or Helium on Arm, RVV on RISC-V, SSE2
+ * on x86 and so on, with no intrinsics. It is only built when the compiler
+ * says the target has SIMD: lowered to scalar code, 64 live words spill on
+ * every round and the one-block core is faster.
+ * Block i of a group uses counter input[12..13] + i.
+ */
+
+#include <string.h>
+#include "xchacha_internal.h"
+
+#ifdef XC_VEC_KERNEL
+
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+
+#define V_ADD(a, b) ((a) + (b))
+#define V_XOR(a, b) ((a) ^ (b))
+#define V_ROT(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+#define V_R16(v) V_ROT(v, 16)
+#define V_R12(v) V_ROT(v, 12)
+#define V_R8(v)  V_ROT(v, 8)
+#define V_R7(v)  V_ROT(v, 7)
+
+size_t xc_blocks_vec(uint32_t *input, const uint8_t *in, uint8_t *out, size_t blocks) {
+    const v4u32 step = {0, 1, 2, 3};
+    size_t done = 0;
+    while (blocks - done >= 4) {
+        v4u32 x[16], lo, hi;
+        uint32_t w[16][4];
+        int i, b;
+        lo = input[12] + step;
+        hi = input[13] - (v4u32)(lo < input[12]);       // comparison is -1 on carry
+        for (i = 0; i < 16; i++) x[i] = (v4u32){0, 0, 0, 0} + input[i];
+        x[12] = lo;  x[13] = hi;
+        for (i = 0; i < 10; i++) {
+            XC_DOUBLEROUND(V, x)
+        }
+        for (i = 0; i < 16; i++) {
+            if ((i & ~1) != 12) x[i] += input[i];
+        }
+        x[12] += lo;
+        x[13] += hi;
+        memcpy(w, x, sizeof(w));                        // w[i][b] is word i of block b
+        for (b = 0; b < 4; b++) {
+            for (i = 0; i < 16; i++) {
+                uint32_t k = w[i][b];
+                xc_store32(&out[i*4], in ? xc_load32(&in[i*4]) ^ k : k);
+            }
+            if (in) in += 64;
+            out += 64;
+        }
+        xc_counter_add(input, 4);
+        done += 4;
+    }
+    return done;
+}
+
+// 20 rounds on 4 independent states stored lane-wise, no feed-forward
+void xc_rounds_x4_vec(uint32_t *s) {
+    v4u32 x[16];
+    int i;
+    memcpy(x, s, sizeof(x));
+    for (i = 0; i < 10; i++) {
+        XC_DOUBLEROUND(V, x)
+    }
+    memcpy(s, x, sizeof(x));
+}
+
+#endif // XC_VEC_KERNEL
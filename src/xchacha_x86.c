@@ -0,0 +1,243 @@
+/* https://github.com/bradleyeckert/xchacha
+ *
+ * Multi-block ChaCha20 kernels for x86: 4 blocks with SSE2, 8 with AVX2 and
+ * 16 with AVX-512. Block i of a group uses counter input[12..13] + i, so the
+ * output is the same as calling the scalar core once per block.
+ * Each function carries its own target attribute, so this file builds with
+ * plain -O2 and the dispatcher in xchacha.c picks a kernel from CPUID.
+ */
+
+#include "xchacha_internal.h"
+
+#ifdef XC_X86_KERNELS
+#include <immintrin.h>
+
+/* ------------------------------------------------------------------------- */
+// SSE2, 4 blocks
+
+#define SSE_ADD(a, b) _mm_add_epi32(a, b)
+#define SSE_XOR(a, b) _mm_xor_si128(a, b)
+#define SSE_ROT(v, n) _mm_or_si128(_mm_slli_epi32(v, n), _mm_srli_epi32(v, 32 - (n)))
+#define SSE_R16(v) _mm_shufflehi_epi16(_mm_shufflelo_epi16(v, 0xB1), 0xB1)
+#define SSE_R12(v) SSE_ROT(v, 12)
+#define SSE_R8(v)  SSE_ROT(v, 8)
+#define SSE_R7(v)  SSE_ROT(v, 7)
+
+// 4x4 transpose of 32-bit words: row k becomes the words of block k
+#define SSE_T4(a, b, c, d) {                                                  \
+    __m128i t0 = _mm_unpacklo_epi32(a, b), t1 = _mm_unpacklo_epi32(c, d);     \
+    __m128i t2 = _mm_unpackhi_epi32(a, b), t3 = _mm_unpackhi_epi32(c, d);     \
+    a = _mm_unpacklo_epi64(t0, t1);  b = _mm_unpackhi_epi64(t0, t1);          \
+    c = _mm_unpacklo_epi64(t2, t3);  d = _mm_unpackhi_epi64(t2, t3); }
+
+#define SSE_OUT(ofs, v) {                                                     \
+    __m128i t = v;                                                            \
+    if (in) t = _mm_xor_si128(t, _mm_loadu_si128((const __m128i *)(in + (ofs)))); \
+    _mm_storeu_si128((__m128i *)(out + (ofs)), t); }
+
+__attribute__((target("sse2")))
+size_t xc_blocks_sse2(uint32_t *input, const uint8_t *in, uint8_t *out, size_t blocks) {
+    const __m128i flip = _mm_set1_epi32((int)0x80000000);
+    size_t done = 0;
+    while (blocks - done >= 4) {
+        __m128i x[16], lo, hi, base;
+        int i;
+        base = _mm_set1_epi32((int)input[12]);
+        lo = _mm_add_epi32(base, _mm_set_epi32(3, 2, 1, 0));
+        hi = _mm_cmpgt_epi32(_mm_xor_si128(base, flip), _mm_xor_si128(lo, flip));
+        hi = _mm_sub_epi32(_mm_set1_epi32((int)input[13]), hi);   // -1 on carry
+        for (i = 0; i < 16; i++) x[i] = _mm_set1_epi32((int)input[i]);
+        x[12] = lo;  x[13] = hi;
+        for (i = 0; i < 10; i++) {
+            XC_DOUBLEROUND(SSE, x)
+        }
+        for (i = 0; i < 16; i++) {
+            if ((i & ~1) != 12) x[i] = _mm_add_epi32(x[i], _mm_set1_epi32((int)input[i]));
+        }
+        x[12] = _mm_add_epi32(x[12], lo);
+        x[13] = _mm_add_epi32(x[13], hi);
+        SSE_T4(x[0], x[1], x[2], x[3])    SSE_T4(x[4], x[5], x[6], x[7])
+        SSE_T4(x[8], x[9], x[10], x[11])  SSE_T4(x[12], x[13], x[14], x[15])
+        for (i = 0; i < 4; i++) {
+            SSE_OUT(i*64,      x[i])
+            SSE_OUT(i*64 + 16, x[i + 4])
+            SSE_OUT(i*64 + 32, x[i + 8])
+            SSE_OUT(i*64 + 48, x[i + 12])
+        }
+        xc_counter_add(input, 4);
+        if (in) in += 256;
+        out += 256;
+        done += 4;
+    }
+    return done;
+}
+
+/* ------------------------------------------------------------------------- */
+// AVX2, 8 blocks
+
+#define AVX_ADD(a, b) _mm256_add_epi32(a, b)
+#define AVX_XOR(a, b) _mm256_xor_si256(a, b)
+#define AVX_ROT(v, n) _mm256_or_si256(_mm256_slli_epi32(v, n), _mm256_srli_epi32(v, 32 - (n)))
+#define AVX_R16(v) _mm256_shuffle_epi8(v, r16)
+#define AVX_R12(v) AVX_ROT(v, 12)
+#define AVX_R8(v)  _mm256_shuffle_epi8(v, r8)
+#define AVX_R7(v)  AVX_ROT(v, 7)
+
+// 4x4 transpose within each 128-bit lane
+#define AVX_T4(a, b, c, d) {                                                  \
+    __m256i t0 = _mm256_unpacklo_epi32(a, b), t1 = _mm256_unpacklo_epi32(c, d); \
+    __m256i t2 = _mm256_unpackhi_epi32(a, b), t3 = _mm256_unpackhi_epi32(c, d); \
+    a = _mm256_unpacklo_epi64(t0, t1);  b = _mm256_unpackhi_epi64(t0, t1);    \
+    c = _mm256_unpacklo_epi64(t2, t3);  d = _mm256_unpackhi_epi64(t2, t3); }
+
+#define AVX_OUT(ofs, v) {                                                     \
+    __m256i t = v;                                                            \
+    if (in) t = _mm256_xor_si256(t, _mm256_loadu_si256((const __m256i *)(in + (ofs)))); \
+    _mm256_storeu_si256((__m256i *)(out + (ofs)), t); }
+
+__attribute__((target("avx2")))
+size_t xc_blocks_avx2(uint32_t *input, const uint8_t *in, uint8_t *out, size_t blocks) {
+    const __m256i r16 = _mm256_set_epi8(13,12,15,14, 9,8,11,10, 5,4,7,6, 1,0,3,2,
+                                        13,12,15,14, 9,8,11,10, 5,4,7,6, 1,0,3,2);
+    const __m256i r8  = _mm256_set_epi8(14,13,12,15, 10,9,8,11, 6,5,4,7, 2,1,0,3,
+                                        14,13,12,15, 10,9,8,11, 6,5,4,7, 2,1,0,3);
+    const __m256i flip = _mm256_set1_epi32((int)0x80000000);
+    size_t done = 0;
+    while (blocks - done >= 8) {
+        __m256i x[16], lo, hi, base;
+        int i;
+        base = _mm256_set1_epi32((int)input[12]);
+        lo = _mm256_add_epi32(base, _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0));
+        hi = _mm256_cmpgt_epi32(_mm256_xor_si256(base, flip), _mm256_xor_si256(lo, flip));
+        hi = _mm256_sub_epi32(_mm256_set1_epi32((int)input[13]), hi);
+        for (i = 0; i < 16; i++) x[i] = _mm256_set1_epi32((int)input[i]);
+        x[12] = lo;  x[13] = hi;
+        for (i = 0; i < 10; i++) {
+            XC_DOUBLEROUND(AVX, x)
+        }
+        for (i = 0; i < 16; i++) {
+            if ((i & ~1) != 12) x[i] = _mm256_add_epi32(x[i], _mm256_set1_epi32((int)input[i]));
+        }
+        x[12] = _mm256_add_epi32(x[12], lo);
+        x[13] = _mm256_add_epi32(x[13], hi);
+        AVX_T4(x[0], x[1], x[2], x[3])    AVX_T4(x[4], x[5], x[6], x[7])
+        AVX_T4(x[8], x[9], x[10], x[11])  AVX_T4(x[12], x[13], x[14], x[15])
+        for (i = 0; i < 4; i++) {       // lane 0 holds block i, lane 1 block i+4
+            AVX_OUT(i*64,           _mm256_permute2x128_si256(x[i],     x[i + 4],  0x20))
+            AVX_OUT(i*64 + 32,      _mm256_permute2x128_si256(x[i + 8], x[i + 12], 0x20))
+            AVX_OUT(i*64 + 256,     _mm256_permute2x128_si256(x[i],     x[i + 4],  0x31))
+            AVX_OUT(i*64 + 256 + 32,_mm256_permute2x128_si256(x[i + 8], x[i + 12], 0x31))
+        }
+        xc_counter_add(input, 8);
+        if (in) in += 512;
+        out += 512;
+        done += 8;
+    }
+    return done;
+}
+
+/* ------------------------------------------------------------------------- */
+// AVX-512, 16 blocks
+
+#define Z_ADD(a, b) _mm512_add_epi32(a, b)
+#define Z_XOR(a, b) _mm512_xor_si512(a, b)
+#define Z_R16(v) _mm512_rol_epi32(v, 16)
+#define Z_R12(v) _mm512_rol_epi32(v, 12)
+#define Z_R8(v)  _mm512_rol_epi32(v, 8)
+#define Z_R7(v)  _mm512_rol_epi32(v, 7)
+
+#define Z_T4(a, b, c, d) {                                                    \
+    __m512i t0 = _mm512_unpacklo_epi32(a, b), t1 = _mm512_unpacklo_epi32(c, d); \
+    __m512i t2 = _mm512_unpackhi_epi32(a, b), t3 = _mm512_unpackhi_epi32(c, d); \
+    a = _mm512_unpacklo_epi64(t0, t1);  b = _mm512_unpackhi_epi64(t0, t1);    \
+    c = _mm512_unpacklo_epi64(t2, t3);  d = _mm512_unpackhi_epi64(t2, t3); }
+
+#define Z_OUT(ofs, v) {                                                       \
+    __m512i t = v;                                                            \
+    if (in) t = _mm512_xor_si512(t, _mm512_loadu_si512((const void *)(in + (ofs)))); \
+    _mm512_storeu_si512((void *)(out + (ofs)), t); }
+
+__attribute__((target("avx512f")))
+size_t xc_blocks_avx512(uint32_t *input, const uint8_t *in, uint8_t *out, size_t blocks) {
+    size_t done = 0;
+    while (blocks - done >= 16) {
+        __m512i x[16], lo, hi, base;
+        __mmask16 carry;
+        int i;
+        base = _mm512_set1_epi32((int)input[12]);
+        lo = _mm512_add_epi32(base, _mm512_set_epi32(15, 14, 13, 12, 11, 10, 9, 8,
+                                                      7, 6, 5, 4, 3, 2, 1, 0));
+        carry = _mm512_cmplt_epu32_mask(lo, base);
+        hi = _mm512_set1_epi32((int)input[13]);
+        hi = _mm512_mask_add_epi32(hi, carry, hi, _mm512_set1_epi32(1));
+        for (i = 0; i < 16; i++) x[i] = _mm512_set1_epi32((int)input[i]);
+        x[12] = lo;  x[13] = hi;
+        for (i = 0; i < 10; i++) {
+            XC_DOUBLEROUND(Z, x)
+        }
+        for (i = 0; i < 16; i++) {
+            if ((i & ~1) != 12) x[i] = _mm512_add_epi32(x[i], _mm512_set1_epi32((int)input[i]));
+        }
+        x[12] = _mm512_add_epi32(x[12], lo);
+        x[13] = _mm512_add_epi32(x[13], hi);
+        Z_T4(x[0], x[1], x[2], x[3])    Z_T4(x[4], x[5], x[6], x[7])
+        Z_T4(x[8], x[9], x[10], x[11])  Z_T4(x[12], x[13], x[14], x[15])
+        for (i = 0; i < 4; i++) {       // lane L of x[i + 4g] holds block i + 4L
+            __m512i a = _mm512_shuffle_i32x4(x[i],     x[i + 4],  0x88);
+            __m512i b = _mm512_shuffle_i32x4(x[i],     x[i + 4],  0xDD);
+            __m512i c = _mm512_shuffle_i32x4(x[i + 8], x[i + 12], 0x88);
+            __m512i d = _mm512_shuffle_i32x4(x[i + 8], x[i + 12], 0xDD);
+            Z_OUT(i*64,        _mm512_shuffle_i32x4(a, c, 0x88))
+            Z_OUT(i*64 + 256,  _mm512_shuffle_i32x4(b, d, 0x88))
+            Z_OUT(i*64 + 512,  _mm512_shuffle_i32x4(a, c, 0xDD))
+            Z_OUT(i*64 + 768,  _mm512_shuffle_i32x4(b, d, 0xDD))
+        }
+        xc_counter_add(input, 16);
+        if (in) in += 1024;
+        out += 1024;
+        done += 16;
+    }
+    return done;
+}
+
+/* ------------------------------------------------------------------------- */
+// 20 rounds on 4, 8 or 16 independent states stored lane-wise, no feed-forward
+
+__attribute__((target("sse2")))
+void xc_rounds_x4_sse2(uint32_t *s) {
+    __m128i x[16];
+    int i;
+    for (i = 0; i < 16; i++) x[i] = _mm_loadu_si128((const __m128i *)&s[i*4]);
+    for (i = 0; i < 10; i++) {
+        XC_DOUBLEROUND(SSE, x)
+    }
+    for (i = 0; i < 16; i++) _mm_storeu_si128((__m128i *)&s[i*4], x[i]);
+}
+
+__attribute__((target("avx2")))
+void xc_rounds_x8_avx2(uint32_t *s) {
+    const __m256i r16 = _mm256_set_epi8(13,12,15,14, 9,8,11,10, 5,4,7,6, 1,0,3,2,
+                                        13,12,15,14, 9,8,11,10, 5,4,7,6, 1,0,3,2);
+    const __m256i r8  = _mm256_set_epi8(14,13,12,15, 10,9,8,11, 6,5,4,7, 2,1,0,3,
+                                        14,13,12,15, 10,9,8,11, 6,5,4,7, 2,1,0,3);
+    __m256i x[16];
+    int i;
+    for (i = 0; i < 16; i++) x[i] = _mm256_loadu_si256((const __m256i *)&s[i*8]);
+    for (i = 0; i < 10; i++) {
+        XC_DOUBLEROUND(AVX, x)
+    }
+    for (i = 0; i < 16; i++) _mm256_storeu_si256((__m256i *)&s[i*8], x[i]);
+}
+
+__attribute__((target("avx512f")))
+void xc_rounds_x16_avx512(uint32_t *s) {
+    __m512i x[16];
+    int i;
+    for (i = 0; i < 16; i++) x[i] = _mm512_loadu_si512((const void *)&s[i*16]);
+    for (i = 0; i < 10; i++) {
+        XC_DOUBLEROUND(Z, x)
+    }
+    for (i = 0; i < 16; i++) _mm512_storeu_si512((void *)&s[i*16], x[i]);
+}
+
+#endif // XC_X86_KERNELS
@@ -8,6 +8,7 @@
 #include <stdint.h>
 #include <string.h>
 #include "./src/xchacha.h"
+#include "./src/xchacha_container.h"
 
 
 /** Calculate and compare the newest test vectors from the IETF
@@ -340,10 +341,871 @@ int check_cpp(void){
     return(0);
 }
 
+/** Encrypt the same buffer in one call and in many odd-sized pieces.
+ * Split calls must resume mid-block, so both outputs must match.
+ * @returns 0 on success, -1 on failure or error
+ *
+ */
+int check_split(void){
+    xChaCha_ctx ctx;
+    uint8_t key[32], iv[24];
+    static uint8_t plaintext[1000], whole[1000], split[1000];
+    static const uint32_t sizes[] = {1, 63, 64, 65, 3, 128, 7, 200, 0, 129};
+    uint32_t i, pos;
+
+    for (i = 0; i < 32; i++) key[i] = (uint8_t)(i * 7 + 1);
+    for (i = 0; i < 24; i++) iv[i] = (uint8_t)(i * 13 + 5);
+    for (i = 0; i < sizeof(plaintext); i++) plaintext[i] = (uint8_t)i;
+
+    xchacha_init(&ctx, key, iv);
+    xchacha_encrypt_bytes(&ctx, plaintext, whole, sizeof(plaintext));
+
+    xchacha_init(&ctx, key, iv);
+    for (i = 0, pos = 0; pos < sizeof(plaintext); i++) {
+        uint32_t n = sizes[i % (sizeof(sizes) / sizeof(sizes[0]))];
+        if (n > sizeof(plaintext) - pos) n = sizeof(plaintext) - pos;
+        xchacha_encrypt_bytes(&ctx, &plaintext[pos], &split[pos], n);
+        pos += n;
+    }
+    if (memcmp(whole, split, sizeof(whole)) != 0) {
+        return(-1);
+    }
+    return(0);
+}
+
+/** Run every multi-block kernel this CPU supports against the scalar core.
+ * The counter starts just below 2^32 so each kernel has to carry from
+ * input[12] into input[13] in the middle of a group of blocks.
+ * @returns 0 on success, -1 on failure or error
+ *
+ */
+int check_kernels(void){
+    xChaCha_ctx ctx;
+    uint8_t key[32], iv[24];
+    uint8_t counter[8] = {0xF5, 0xFF, 0xFF, 0xFF, 0x01};
+    static uint8_t plaintext[64 * 37 + 5], ref[64 * 37 + 5], buffer[64 * 37 + 5];
+    int id, best = xchacha_kernel(), result = 0;
+    uint32_t i;
+
+    for (i = 0; i < 32; i++) key[i] = (uint8_t)(i * 3 + 11);
+    for (i = 0; i < 24; i++) iv[i] = (uint8_t)(i * 5 + 2);
+    for (i = 0; i < sizeof(plaintext); i++) plaintext[i] = (uint8_t)(i >> 2);
+
+    xchacha_kernel_select(XC_KERNEL_SCALAR);
+    xchacha_init(&ctx, key, iv);
+    xchacha_set_counter(&ctx, counter);
+    xchacha_encrypt_bytes(&ctx, plaintext, ref, sizeof(plaintext));
+
+    for (id = XC_KERNEL_SCALAR + 1; id < XC_KERNELS; id++) {
+        if (xchacha_kernel_select(id) != 0) continue;
+        xchacha_init(&ctx, key, iv);
+        xchacha_set_counter(&ctx, counter);
+        xchacha_encrypt_bytes(&ctx, plaintext, buffer, 3);  // start mid-block
+        xchacha_encrypt_bytes(&ctx, &plaintext[3], &buffer[3], sizeof(plaintext) - 3);
+        if (memcmp(buffer, ref, sizeof(ref)) != 0) {
+            printf("Kernel %s mismatch\n", xchacha_kernel_name(id));
+            result = -1;
+        }
+    }
+    xchacha_kernel_select(best);
+    return(result);
+}
+
+/** Seek to assorted byte offsets and compare with a sequential run.
+ * @returns 0 on success, -1 on failure or error
+ *
+ */
+int check_seek(void){
+    xChaCha_ctx ctx;
+    uint8_t key[32], iv[24];
+    static uint8_t plaintext[1000], ref[1000], buffer[1000];
+    static const uint32_t offsets[] = {0, 1, 63, 64, 65, 127, 500, 640, 999};
+    uint32_t i, ofs;
+
+    for (i = 0; i < 32; i++) key[i] = (uint8_t)(i + 0x30);
+    for (i = 0; i < 24; i++) iv[i] = (uint8_t)(0xF0 - i);
+    for (i = 0; i < sizeof(plaintext); i++) plaintext[i] = (uint8_t)(i * 11);
+
+    xchacha_init(&ctx, key, iv);
+    xchacha_encrypt_bytes(&ctx, plaintext, ref, sizeof(plaintext));
+    if (xchacha_tell(&ctx) != sizeof(plaintext)) return(-1);
+
+    for (i = 0; i < sizeof(offsets) / sizeof(offsets[0]); i++) {
+        ofs = offsets[i];
+        xchacha_encrypt_bytes(&ctx, plaintext, buffer, 17);  // leave junk in chabuf
+        xchacha_seek(&ctx, ofs);
+        if (xchacha_tell(&ctx) != ofs) return(-1);
+        xchacha_encrypt_bytes(&ctx, &plaintext[ofs], &buffer[ofs], sizeof(plaintext) - ofs);
+        if (memcmp(&buffer[ofs], &ref[ofs], sizeof(ref) - ofs) != 0) {
+            return(-1);
+        }
+    }
+    return(0);
+}
+
+/** Encrypt a large buffer on several threads and compare with one thread.
+ * The context must also end up where a sequential run leaves it.
+ * @returns 0 on success, -1 on failure or error
+ *
+ */
+int check_parallel(void){
+    xChaCha_ctx ctx;
+    uint8_t key[32], iv[24];
+    const size_t len = 1024 * 1024 + 37;
+    uint8_t *plaintext, *ref, *buffer;
+    uint64_t pos;
+    size_t i;
+    int result = 0;
+
+    plaintext = malloc(len);
+    ref = malloc(len + 100);
+    buffer = malloc(len + 100);
+    if (!plaintext || !ref || !buffer) {
+        perror("malloc() error");
+        free(plaintext);  free(ref);  free(buffer);
+        return(-1);
+    }
+    for (i = 0; i < 32; i++) key[i] = (uint8_t)(i ^ 0x5A);
+    for (i = 0; i < 24; i++) iv[i] = (uint8_t)(i * 9);
+    for (i = 0; i < len; i++) plaintext[i] = (uint8_t)(i * 31 + (i >> 9));
+
+    xchacha_init(&ctx, key, iv);
+    xchacha_encrypt_bytes(&ctx, plaintext, ref, 5);
+    xchacha_encrypt_bytes(&ctx, &plaintext[5], &ref[5], (uint32_t)(len - 5));
+    xchacha_encrypt_bytes(&ctx, plaintext, &ref[len], 100);
+    pos = xchacha_tell(&ctx);
+
+    xchacha_init(&ctx, key, iv);
+    xchacha_encrypt_bytes(&ctx, plaintext, buffer, 5);
+    xchacha_encrypt_parallel(&ctx, &plaintext[5], &buffer[5], len - 5, 4);
+    xchacha_encrypt_bytes(&ctx, plaintext, &buffer[len], 100);
+    if ((xchacha_tell(&ctx) != pos) || memcmp(buffer, ref, len + 100) != 0) {
+        result = -1;
+    }
+    free(plaintext);  free(ref);  free(buffer);
+    return(result);
+}
+
+/** Poly1305 test vector from RFC 8439 section 2.5.2, fed in odd pieces.
+ * @returns 0 on success, -1 on failure or error
+ *
+ */
+int check_poly1305(void){
+    xc_poly1305_ctx poly;
+    uint8_t mac[16];
+    uint8_t key[] = {
+        0x85, 0xd6, 0xbe, 0x78, 0x57, 0x55, 0x6d, 0x33,
+        0x7f, 0x44, 0x52, 0xfe, 0x42, 0xd5, 0x06, 0xa8,
+        0x01, 0x03, 0x80, 0x8a, 0xfb, 0x0d, 0xb2, 0xfd,
+        0x4a, 0xbf, 0xf6, 0xaf, 0x41, 0x49, 0xf5, 0x1b
+    };
+    uint8_t correct_tag[] = {
+        0xa8, 0x06, 0x1d, 0xc1, 0x30, 0x51, 0x36, 0xc6,
+        0xc2, 0x2b, 0x8b, 0xaf, 0x0c, 0x01, 0x27, 0xa9
+    };
+    uint8_t msg[] = "Cryptographic Forum Research Group";
+
+    xc_poly1305_init(&poly, key);
+    xc_poly1305_update(&poly, msg, 5);
+    xc_poly1305_update(&poly, &msg[5], 20);
+    xc_poly1305_update(&poly, &msg[25], 9);
+    xc_poly1305_final(&poly, mac);
+    if (memcmp(mac, correct_tag, 16) != 0) {
+        return(-1);
+    }
+    return(0);
+}
+
+/** XChaCha20-Poly1305 test vector from the IETF draft, section A.3.1:
+ * https://tools.ietf.org/html/draft-arciszewski-xchacha-03
+ * Also checks that a corrupted tag is rejected.
+ * @returns 0 on success, -1 on failure or error
+ *
+ */
+int check_aead(void){
+    xchacha_aead_ctx ctx;
+    uint8_t buffer[114], tag[16];
+    uint8_t plaintext[] = "Ladies and Gentlemen of the class of '99: "
+        "If I could offer you only one tip for the future, sunscreen would be it.";
+    uint8_t aad[] = {
+        0x50, 0x51, 0x52, 0x53, 0xc0, 0xc1, 0xc2, 0xc3,
+        0xc4, 0xc5, 0xc6, 0xc7
+    };
+    uint8_t key[] = {
+        0x80, 0x81, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+        0x88, 0x89, 0x8a, 0x8b, 0x8c, 0x8d, 0x8e, 0x8f,
+        0x90, 0x91, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97,
+        0x98, 0x99, 0x9a, 0x9b, 0x9c, 0x9d, 0x9e, 0x9f
+    };
+    uint8_t iv[] = {
+        0x40, 0x41, 0x42, 0x43, 0x44, 0x45, 0x46, 0x47,
+        0x48, 0x49, 0x4a, 0x4b, 0x4c, 0x4d, 0x4e, 0x4f,
+        0x50, 0x51, 0x52, 0x53, 0x54, 0x55, 0x56, 0x57
+    };
+    uint8_t correct_ciphertext[] = {
+        0xbd, 0x6d, 0x17, 0x9d, 0x3e, 0x83, 0xd4, 0x3b,
+        0x95, 0x76, 0x57, 0x94, 0x93, 0xc0, 0xe9, 0x39,
+        0x57, 0x2a, 0x17, 0x00, 0x25, 0x2b, 0xfa, 0xcc,
+        0xbe, 0xd2, 0x90, 0x2c, 0x21, 0x39, 0x6c, 0xbb,
+        0x73, 0x1c, 0x7f, 0x1b, 0x0b, 0x4a, 0xa6, 0x44,
+        0x0b, 0xf3, 0xa8, 0x2f, 0x4e, 0xda, 0x7e, 0x39,
+        0xae, 0x64, 0xc6, 0x70, 0x8c, 0x54, 0xc2, 0x16,
+        0xcb, 0x96, 0xb7, 0x2e, 0x12, 0x13, 0xb4, 0x52,
+        0x2f, 0x8c, 0x9b, 0xa4, 0x0d, 0xb5, 0xd9, 0x45,
+        0xb1, 0x1b, 0x69, 0xb9, 0x82, 0xc1, 0xbb, 0x9e,
+        0x3f, 0x3f, 0xac, 0x2b, 0xc3, 0x69, 0x48, 0x8f,
+        0x76, 0xb2, 0x38, 0x35, 0x65, 0xd3, 0xff, 0xf9,
+        0x21, 0xf9, 0x66, 0x4c, 0x97, 0x63, 0x7d, 0xa9,
+        0x76, 0x88, 0x12, 0xf6, 0x15, 0xc6, 0x8b, 0x13,
+        0xb5, 0x2e
+    };
+    uint8_t correct_tag[] = {
+        0xc0, 0x87, 0x59, 0x24, 0xc1, 0xc7, 0x98, 0x79,
+        0x47, 0xde, 0xaf, 0xd8, 0x78, 0x0a, 0xcf, 0x49
+    };
+
+    xchacha_aead_seal(key, iv, aad, sizeof(aad), plaintext, buffer, 114, tag);
+    if (memcmp(buffer, correct_ciphertext, 114) != 0
+     || memcmp(tag, correct_tag, 16) != 0) {
+        return(-1);
+    }
+
+    /* Incremental, in place, in uneven pieces */
+    xchacha_aead_init(&ctx, key, iv);
+    xchacha_aead_aad(&ctx, aad, 5);
+    xchacha_aead_aad(&ctx, &aad[5], 7);
+    xchacha_aead_decrypt_update(&ctx, buffer, buffer, 50);
+    xchacha_aead_decrypt_update(&ctx, &buffer[50], &buffer[50], 64);
+    if (xchacha_aead_verify(&ctx, tag) != 0
+     || memcmp(buffer, plaintext, 114) != 0) {
+        return(-1);
+    }
+
+    tag[0] ^= 1;
+    if (xchacha_aead_open(key, iv, aad, sizeof(aad), correct_ciphertext,
+                          buffer, 114, tag) == 0) {
+        return(-1);
+    }
+    return(0);
+}
+
+/** Encrypt a batch of messages with assorted lengths under each kernel and
+ * compare with encrypting them one at a time.
+ * @returns 0 on success, -1 on failure or error
+ *
+ */
+int check_batch(void){
+    enum { MSGS = 37, MAXLEN = 3001 };
+    static const size_t lengths[] = {0, 1, 63, 64, 65, 100, 128, 200, 1500, 777,
+                                     1536, 1537, 2048, 3001};
+    static uint8_t keys[MSGS][32], ivs[MSGS][24];
+    static uint8_t plaintext[MAXLEN], ref[MSGS][MAXLEN], buffer[MSGS][MAXLEN];
+    xchacha_msg msgs[MSGS];
+    xChaCha_ctx ctx;
+    int id, best = xchacha_kernel(), result = 0;
+    size_t i, m;
+
+    for (i = 0; i < sizeof(plaintext); i++) plaintext[i] = (uint8_t)(i * 7);
+    for (m = 0; m < MSGS; m++) {
+        for (i = 0; i < 32; i++) keys[m][i] = (uint8_t)(m * 32 + i);
+        for (i = 0; i < 24; i++) ivs[m][i] = (uint8_t)(m + i * 17);
+        msgs[m].key = keys[m];
+        msgs[m].nonce = ivs[m];
+        msgs[m].in = plaintext;
+        msgs[m].out = buffer[m];
+        msgs[m].len = lengths[m % (sizeof(lengths) / sizeof(lengths[0]))];
+        xchacha_init(&ctx, keys[m], ivs[m]);
+        xchacha_encrypt_bytes(&ctx, plaintext, ref[m], (uint32_t)msgs[m].len);
+    }
+    for (id = XC_KERNEL_SCALAR; id < XC_KERNELS; id++) {
+        if (xchacha_kernel_select(id) != 0) continue;
+        memset(buffer, 0, sizeof(buffer));
+        xchacha_encrypt_batch(msgs, MSGS);
+        for (m = 0; m < MSGS; m++) {
+            if (memcmp(buffer[m], ref[m], msgs[m].len) != 0) {
+                printf("Batch mismatch with kernel %s\n", xchacha_kernel_name(id));
+                result = -1;
+                break;
+            }
+        }
+    }
+    xchacha_kernel_select(best);
+    return(result);
+}
+
+/** Reduced-round variants: split calls must match one-shot calls, and
+ * 8, 12 and 20 rounds must all give different keystreams.
+ * @returns 0 on success, -1 on failure or error
+ *
+ */
+int check_reduced(void){
+    xChaCha_ctx ctx;
+    uint8_t key[32], iv[24];
+    static uint8_t zeros[300], ks8[300], ks12[300], ks20[300], split[300];
+    uint32_t i;
+
+    for (i = 0; i < 32; i++) key[i] = (uint8_t)(i * 5);
+    for (i = 0; i < 24; i++) iv[i] = (uint8_t)(i * 3 + 1);
+
+    xchacha8_init(&ctx, key, iv);
+    xchacha8_encrypt_bytes(&ctx, zeros, ks8, 300);
+    xchacha12_init(&ctx, key, iv);
+    xchacha12_encrypt_bytes(&ctx, zeros, ks12, 300);
+    xchacha_init(&ctx, key, iv);
+    xchacha_encrypt_bytes(&ctx, zeros, ks20, 300);
+    if (!memcmp(ks8, ks12, 300) || !memcmp(ks12, ks20, 300) || !memcmp(ks8, ks20, 300)) {
+        return(-1);
+    }
+    xchacha12_init(&ctx, key, iv);
+    xchacha12_encrypt_bytes(&ctx, zeros, split, 10);
+    xchacha12_encrypt_bytes(&ctx, zeros, &split[10], 150);
+    xchacha12_encrypt_bytes(&ctx, zeros, &split[160], 140);
+    if (memcmp(split, ks12, 300) != 0) {
+        return(-1);
+    }
+    return(0);
+}
+
+/** Write a chunked container in odd pieces, then read back ranges that
+ * start, end and straddle chunk boundaries. Large reads run on 4 threads
+ * and must match a single-threaded read.
+ * @returns 0 on success, -1 on failure or error
+ *
+ */
+int check_container(void){
+    enum { SIZE = 300000, CHUNK = 4096 };
+    static const uint32_t ranges[][2] = {
+        {0, SIZE}, {5000, 100}, {4090, 200}, {SIZE - 10, 10}, {8192, 4096}, {0, 0},
+        {1000, SIZE - 2000}
+    };
+    static uint8_t plaintext[SIZE], buffer[SIZE], single[SIZE];
+    xcc_writer w;
+    xcc_reader r;
+    uint8_t key[32], iv[24];
+    FILE *f;
+    uint32_t i;
+    int result = 0;
+
+    for (i = 0; i < 32; i++) key[i] = (uint8_t)(i + 100);
+    for (i = 0; i < 24; i++) iv[i] = (uint8_t)(i * 29);
+    for (i = 0; i < SIZE; i++) plaintext[i] = (uint8_t)(i ^ (i >> 8));
+    if ((f = tmpfile()) == NULL) {
+        perror("tmpfile() error");
+        return(-1);
+    }
+    if (xcc_writer_open(&w, f, key, iv, CHUNK)
+     || xcc_writer_write(&w, plaintext, 1000)
+     || xcc_writer_write(&w, &plaintext[1000], SIZE - 1000)
+     || xcc_writer_close(&w)
+     || xcc_open(&r, f, key)) {
+        fclose(f);
+        return(-1);
+    }
+    for (i = 0; i < sizeof(ranges) / sizeof(ranges[0]); i++) {
+        uint32_t ofs = ranges[i][0], len = ranges[i][1];
+        if (xcc_read(&r, ofs, buffer, len, (len > 50000) ? 4 : 1)
+         || xcc_read(&r, ofs, single, len, 1)
+         || memcmp(buffer, &plaintext[ofs], len) || memcmp(buffer, single, len)) {
+            result = -1;
+        }
+    }
+    if (xcc_read(&r, SIZE - 5, buffer, 10, 1) == 0) {  // past the end
+        result = -1;
+    }
+    xcc_close(&r);
+    fclose(f);
+
+    // Crafted header: 0 chunks claiming UINT64_MAX-10 bytes must be rejected
+    memset(buffer, 0, 64);
+    memcpy(buffer, "XCC1\x01\x00\x40\x00\x40\x00\x00\x00", 12);
+    for (i = 0; i < 8; i++) buffer[16 + i] = (uint8_t)((UINT64_MAX - 10) >> (i * 8));
+    buffer[24] = 64;                                    // index offset
+    if ((f = tmpfile()) == NULL) {
+        perror("tmpfile() error");
+        return(-1);
+    }
+    if ((fwrite(buffer, 1, 64, f) != 64) || (xcc_open(&r, f, key) == 0)) {
+        result = -1;
+    }
+    fclose(f);
+    return(result);
+}
+
+/** The generic cipher descriptor's bulk path must match 16-byte calls.
+ * @returns 0 on success, -1 on failure or error
+ *
+ */
+int check_cipher(void){
+    const xc_cipher *cipher = &xc_cipher_xchacha;
+    uint8_t key[32], iv[16];
+    static uint8_t plaintext[16 * 100], ref[16 * 100], buffer[16 * 100];
+    void *ctx;
+    uint32_t i;
+
+    if ((ctx = malloc(cipher->ctx_size)) == NULL) {
+        perror("malloc() error");
+        return(-1);
+    }
+    for (i = 0; i < 32; i++) key[i] = (uint8_t)(i * 77);
+    for (i = 0; i < 16; i++) iv[i] = (uint8_t)(i * 19);
+    for (i = 0; i < sizeof(plaintext); i++) plaintext[i] = (uint8_t)(i + 1);
+
+    xc_crypt_init(ctx, key, iv);
+    for (i = 0; i < 100; i++) {
+        xc_crypt_block(ctx, &plaintext[i * 16], &ref[i * 16], XC_ENCRYPT);
+    }
+    cipher->init(ctx, key, iv);
+    cipher->crypt_blocks(ctx, plaintext, buffer, 1, XC_ENCRYPT);
+    cipher->crypt_blocks(ctx, &plaintext[16], &buffer[16], 99, XC_ENCRYPT);
+    free(ctx);
+    if (memcmp(buffer, ref, sizeof(ref)) != 0) {
+        return(-1);
+    }
+    return(0);
+}
+
+/** Check that the random generator is repeatable from a seed no matter how
+ * the requests are split, and that u32/u64 come from the same stream.
+ * @returns 0 on success, -1 on failure or error
+ */
+int check_random(void){
+    uint8_t seed[32], a[3000], b[3000], c[3000];
+    uint32_t u32;
+    uint64_t u64;
+    int i;
+
+    for (i = 0; i < 32; i++) seed[i] = (uint8_t)(i * 3 + 1);
+    xchacha_random_seed(seed);
+    xchacha_random_bytes(a, 1000);
+    xchacha_random_bytes(&a[1000], 2000);       // bigger than the buffer
+    xchacha_random_seed(seed);
+    for (i = 0; i < 1000; i += 100) xchacha_random_bytes(&b[i], 100);
+    xchacha_random_bytes(&b[1000], 2000);
+    if (memcmp(a, b, sizeof(a)) != 0) {
+        return(-1);
+    }
+    xchacha_random_seed(seed);
+    u32 = xchacha_random_u32();
+    u64 = xchacha_random_u64();
+    memcpy(c, &u32, 4);
+    memcpy(&c[4], &u64, 8);
+    if (memcmp(a, c, 12) != 0) {
+        return(-1);
+    }
+    xchacha_random_bytes(c, sizeof(c));         // key erased, stream moves on
+    if (memcmp(&a[12], c, 1000) == 0) {
+        return(-1);
+    }
+    xchacha_random_bytes(a, 64);
+    xchacha_random_bytes(b, 64);
+    if (memcmp(a, b, 64) == 0) {
+        return(-1);
+    }
+    return(0);
+}
+
+/** Check the statistics counters when they are built in (-DXCHACHA_STATS).
+ * Passes trivially otherwise.
+ * @returns 0 on success, -1 on failure or error
+ */
+int check_stats(void){
+    xChaCha_ctx ctx;
+    xchacha_stats s;
+    uint8_t key[32] = {1}, iv[24] = {2}, buffer[100] = {0};
+    char json[2048];
+    uint64_t blocks = 0;
+    int i;
+
+    xchacha_stats_reset();
+    if (xchacha_stats_snapshot(&s, 0) != 0) {
+        return(0);                              // not built in
+    }
+    xchacha_init(&ctx, key, iv);
+    xchacha_encrypt_bytes(&ctx, buffer, buffer, 100);
+    xchacha_seek(&ctx, 1000);
+    xchacha_stats_snapshot(&s, 0);
+    for (i = 0; i < XC_KERNELS; i++) blocks += s.blocks[i];
+    if ((s.inits != 1) || (s.hchacha != 1) || (s.bytes != 100)
+     || (blocks != 3) || (s.wasted != 92)) {
+        return(-1);
+    }
+    if (xchacha_stats_snapshot(&s, 1) || (s.bytes < 100)) {
+        return(-1);
+    }
+    i = xchacha_stats_json(&s, json, sizeof(json));
+    if ((i <= 0) || (i >= (int)sizeof(json)) || (json[0] != '{') || (json[i - 1] != '}')) {
+        return(-1);
+    }
+    return(0);
+}
+
+/** Check that scatter-gather encryption over uneven segment lists matches
+ * one contiguous call, both out of place and in place.
+ * @returns 0 on success, -1 on failure or error
+ */
+int check_iov(void){
+    xChaCha_ctx ctx;
+    uint8_t key[32], iv[24];
+    static uint8_t plaintext[5000], ref[5000], buffer[5000];
+    static const size_t in_lens[]  = {0, 1, 63, 64, 200, 7, 1000, 0, 2500, 1165};
+    static const size_t out_lens[] = {130, 4096, 3, 771};
+    xchacha_iovec in[10], out[4];
+    size_t i, ofs;
+
+    for (i = 0; i < 32; i++) key[i] = (uint8_t)(i + 9);
+    for (i = 0; i < 24; i++) iv[i] = (uint8_t)(i * 5);
+    for (i = 0; i < sizeof(plaintext); i++) plaintext[i] = (uint8_t)(i * 13);
+    xchacha_init(&ctx, key, iv);
+    xchacha_seek(&ctx, 17);
+    xchacha_encrypt(&ctx, plaintext, ref, sizeof(ref));
+
+    for (i = 0, ofs = 0; i < 10; ofs += in_lens[i++]) {
+        in[i].base = &plaintext[ofs];
+        in[i].len = in_lens[i];
+    }
+    for (i = 0, ofs = 0; i < 4; ofs += out_lens[i++]) {
+        out[i].base = &buffer[ofs];
+        out[i].len = out_lens[i];
+    }
+    xchacha_init(&ctx, key, iv);
+    xchacha_seek(&ctx, 17);
+    if ((xchacha_encrypt_iov(&ctx, in, 10, out, 4) != sizeof(buffer))
+     || (memcmp(buffer, ref, sizeof(ref)) != 0)
+     || (xchacha_tell(&ctx) != 17 + sizeof(buffer))) {
+        return(-1);
+    }
+
+    memcpy(buffer, plaintext, sizeof(buffer));  // in place, same list twice
+    xchacha_init(&ctx, key, iv);
+    xchacha_seek(&ctx, 17);
+    if ((xchacha_encrypt_iov(&ctx, out, 4, out, 4) != sizeof(buffer))
+     || (memcmp(buffer, ref, sizeof(ref)) != 0)) {
+        return(-1);
+    }
+    out[3].len = 10;                            // shorter output list
+    if (xchacha_encrypt_iov(&ctx, in, 10, out, 4) != 4239) {
+        return(-1);
+    }
+    return(0);
+}
+
+/** Check the keystream ring against xchacha_encrypt: explicit prefetch with
+ * the ring running dry part way, then a helper thread keeping it full.
+ * @returns 0 on success, -1 on failure or error
+ */
+int check_ring(void){
+    xChaCha_ctx ctx;
+    xchacha_ring ring;
+    uint8_t key[32], iv[24];
+    static uint8_t plaintext[100000], ref[100000], buffer[100000];
+    static const size_t lens[] = {5, 64, 59, 1000, 3000, 1, 128, 4096, 20000, 70000};
+    size_t i, ofs;
+    int result = 0;
+
+    for (i = 0; i < 32; i++) key[i] = (uint8_t)(i * 7);
+    for (i = 0; i < 24; i++) iv[i] = (uint8_t)(i + 100);
+    for (i = 0; i < sizeof(plaintext); i++) plaintext[i] = (uint8_t)(i >> 3);
+    xchacha_init(&ctx, key, iv);
+    xchacha_seek(&ctx, 30);
+    if (xchacha_ring_init(&ring, &ctx, 24) == 0) {
+        xchacha_ring_free(&ring);
+        return(-1);                             // not a power of two
+    }
+    xchacha_encrypt(&ctx, plaintext, ref, sizeof(ref));
+
+    xchacha_init(&ctx, key, iv);
+    xchacha_seek(&ctx, 30);
+    if (xchacha_ring_init(&ring, &ctx, 32) != 0) {
+        perror("xchacha_ring_init() error");
+        return(-1);
+    }
+    for (i = 0, ofs = 0; (result == 0) && (ofs < sizeof(buffer)); i++) {
+        size_t n = lens[i % 10];
+        if (n > sizeof(buffer) - ofs) n = sizeof(buffer) - ofs;
+        if ((i & 1) && (xchacha_prefetch(&ring, 1000) < 1000)) {
+            result = -1;
+        }
+        xchacha_ring_encrypt(&ring, &plaintext[ofs], &buffer[ofs], n);
+        ofs += n;
+    }
+    xchacha_ring_free(&ring);
+    if ((result != 0) || (memcmp(buffer, ref, sizeof(ref)) != 0)) {
+        return(-1);
+    }
+
+    memset(buffer, 0, sizeof(buffer));
+    xchacha_init(&ctx, key, iv);
+    xchacha_seek(&ctx, 30);
+    if (xchacha_ring_init(&ring, &ctx, 64) != 0) {
+        perror("xchacha_ring_init() error");
+        return(-1);
+    }
+    if (xchacha_ring_start(&ring) != 0) {
+        result = -1;
+    }
+    for (i = 0, ofs = 0; (result == 0) && (ofs < sizeof(buffer)); i++) {
+        size_t n = lens[i % 10];
+        if (n > sizeof(buffer) - ofs) n = sizeof(buffer) - ofs;
+        xchacha_ring_encrypt(&ring, &plaintext[ofs], &buffer[ofs], n);
+        ofs += n;
+    }
+    xchacha_ring_free(&ring);                   // also stops the helper
+    if (memcmp(buffer, ref, sizeof(ref)) != 0) {
+        result = -1;
+    }
+    return(result);
+}
+
+/** Check SipHash-2-4 and HalfSipHash-2-4 against the reference vectors
+ * (https://github.com/veorq/SipHash) and the batch call against single calls
+ * on every kernel.
+ * @returns 0 on success, -1 on failure or error
+ */
+int check_siphash(void){
+    static const uint8_t half_empty[4] = {0xa9, 0x35, 0x9f, 0x5b};
+    uint8_t key[16], msg[100];
+    const uint8_t *m[37];
+    size_t len[37];
+    uint64_t hash[37];
+    uint32_t h32;
+    int i, id, best = xchacha_kernel();
+
+    for (i = 0; i < 16; i++) key[i] = (uint8_t)i;
+    for (i = 0; i < 100; i++) msg[i] = (uint8_t)i;
+    if ((xc_siphash(key, msg, 15) != 0xa129ca6149be45e5ull)
+     || (xc_siphash(key, msg, 0) != 0x726fdb47dd0e0e31ull)) {
+        return(-1);
+    }
+    h32 = xc_halfsiphash(key, msg, 0);
+    for (i = 0; i < 4; i++) {
+        if ((uint8_t)(h32 >> (i * 8)) != half_empty[i]) {
+            return(-1);
+        }
+    }
+    for (i = 0; i < 37; i++) {                  // uneven lengths up to 95
+        m[i] = &msg[i % 5];
+        len[i] = (size_t)(i * 11) % 96;
+    }
+    for (id = XC_KERNEL_SCALAR; id < XC_KERNELS; id++) {
+        if (xchacha_kernel_select(id) != 0) continue;
+        memset(hash, 0, sizeof(hash));
+        xc_siphash_batch(key, m, len, hash, 37);
+        for (i = 0; i < 37; i++) {
+            if (hash[i] != xc_siphash(key, m[i], len[i])) {
+                xchacha_kernel_select(best);
+                return(-1);
+            }
+        }
+    }
+    xchacha_kernel_select(best);
+    return(0);
+}
+
+/** Check that a compact session picks up where it left off across calls,
+ * converts to and from a full context, and that the arena reuses slots and
+ * rejects double and out-of-range frees.
+ * @returns 0 on success, -1 on failure or error
+ */
+int check_session(void){
+    xChaCha_ctx ctx;
+    xchacha_arena arena;
+    xchacha_session *s;
+    uint8_t key[32], iv[24];
+    static uint8_t plaintext[3000], ref[3000], buffer[3000];
+    uint32_t h[3], i;
+
+    if (sizeof(xchacha_session) != 48) {
+        return(-1);
+    }
+    for (i = 0; i < 32; i++) key[i] = (uint8_t)(i * 11);
+    for (i = 0; i < 24; i++) iv[i] = (uint8_t)(i * 3 + 7);
+    for (i = 0; i < sizeof(plaintext); i++) plaintext[i] = (uint8_t)(i * 29);
+    xchacha_init(&ctx, key, iv);
+    xchacha_encrypt(&ctx, plaintext, ref, sizeof(ref));
+
+    if ((xchacha_arena_init(&arena, 2) != 0)
+     || ((h[0] = xchacha_arena_alloc(&arena)) != 0)
+     || ((h[1] = xchacha_arena_alloc(&arena)) != 1)
+     || (xchacha_arena_alloc(&arena) != XC_ARENA_NONE)) {
+        return(-1);
+    }
+    if ((xchacha_arena_free(&arena, h[0]) != 0)
+     || (xchacha_arena_free(&arena, h[0]) == 0)        // double free
+     || (xchacha_arena_free(&arena, 2) == 0)            // out of range
+     || ((h[2] = xchacha_arena_alloc(&arena)) != 0) || (arena.count != 2)) {
+        xchacha_arena_destroy(&arena);
+        return(-1);
+    }
+    s = &arena.slots[h[2]];
+    xchacha_session_init(s, key, iv);
+    xchacha_session_encrypt(s, plaintext, buffer, 100);
+    xchacha_session_encrypt(s, &plaintext[100], &buffer[100], 1);
+    xchacha_session_encrypt(s, &plaintext[101], &buffer[101], 1000);
+    xchacha_session_expand(s, &ctx);            // continue on a full context
+    xchacha_encrypt(&ctx, &plaintext[1101], &buffer[1101], 99);
+    xchacha_session_compact(&arena.slots[h[1]], &ctx);
+    xchacha_session_encrypt(&arena.slots[h[1]], &plaintext[1200], &buffer[1200], 1800);
+    xchacha_arena_destroy(&arena);
+    if (memcmp(buffer, ref, sizeof(ref)) != 0) {
+        return(-1);
+    }
+    return(0);
+}
+
+/** Check sector-addressed encryption against seeking to each sector.
+ * @returns 0 on success, -1 on failure or error
+ */
+int check_sectors(void){
+    xChaCha_ctx ctx;
+    uint8_t key[32], iv[24];
+    static uint8_t plaintext[8 * 4096], ref[8 * 4096], buffer[8 * 4096];
+    static const size_t sizes[] = {64, 512, 4096};
+    uint32_t i, j;
+
+    for (i = 0; i < 32; i++) key[i] = (uint8_t)(i ^ 0x5A);
+    for (i = 0; i < 24; i++) iv[i] = (uint8_t)(i * 9);
+    for (i = 0; i < sizeof(plaintext); i++) plaintext[i] = (uint8_t)(i * 7 + 3);
+    xchacha_init(&ctx, key, iv);
+    for (j = 0; j < 3; j++) {
+        size_t n = sizeof(plaintext) / sizes[j];
+        for (i = 0; i < n; i++) {
+            xchacha_seek(&ctx, (1000 + i) * (uint64_t)sizes[j]);
+            xchacha_encrypt(&ctx, &plaintext[i * sizes[j]], &ref[i * sizes[j]], sizes[j]);
+        }
+        xchacha_init(&ctx, key, iv);
+        xchacha_encrypt_bytes(&ctx, plaintext, buffer, 10);     // ctx position is ignored
+        memcpy(buffer, plaintext, sizeof(buffer));
+        if ((xchacha_crypt_sectors(&ctx, 1000, sizes[j], 1, buffer, buffer) != 0)
+         || (xchacha_crypt_sectors(&ctx, 1001, sizes[j], n - 1, &buffer[sizes[j]],
+                                   &buffer[sizes[j]]) != 0)
+         || (memcmp(buffer, ref, sizeof(ref)) != 0)) {
+            return(-1);
+        }
+    }
+    if ((xchacha_crypt_sectors(&ctx, 0, 520, 1, plaintext, buffer) == 0)
+     || (xchacha_crypt_sectors(&ctx, UINT64_MAX / 8, 512, 1, plaintext, buffer) == 0)) {
+        return(-1);
+    }
+    return(0);
+}
+
+/** Check CRC32C against the standard check value and the fused calls
+ * against separate encrypt and checksum passes.
+ * @returns 0 on success, -1 on failure or error
+ */
+int check_crc32c(void){
+    xChaCha_ctx ctx;
+    uint8_t key[32], iv[24];
+    static uint8_t plaintext[5000], ref[5000], buffer[5000];
+    uint32_t i, crc, expect;
+
+    if ((xc_crc32c(0, (const uint8_t *)"123456789", 9) != 0xE3069283)
+     || (xc_crc32c(xc_crc32c(0, (const uint8_t *)"1234", 4), (const uint8_t *)"56789", 5)
+         != 0xE3069283)) {
+        return(-1);
+    }
+    for (i = 0; i < 32; i++) key[i] = (uint8_t)(i * 5 + 1);
+    for (i = 0; i < 24; i++) iv[i] = (uint8_t)(i * 31);
+    for (i = 0; i < sizeof(plaintext); i++) plaintext[i] = (uint8_t)(i * 3);
+    xchacha_init(&ctx, key, iv);
+    xchacha_encrypt(&ctx, plaintext, ref, sizeof(ref));
+    expect = xc_crc32c(0, ref, sizeof(ref));
+
+    xchacha_init(&ctx, key, iv);
+    crc = xchacha_encrypt_crc32c(&ctx, plaintext, buffer, 77, 0);
+    crc = xchacha_encrypt_crc32c(&ctx, &plaintext[77], &buffer[77], sizeof(buffer) - 77, crc);
+    if ((crc != expect) || (memcmp(buffer, ref, sizeof(ref)) != 0)) {
+        return(-1);
+    }
+    xchacha_init(&ctx, key, iv);                // decrypt in place
+    crc = xchacha_decrypt_crc32c(&ctx, buffer, buffer, 3001, 0);
+    crc = xchacha_decrypt_crc32c(&ctx, &buffer[3001], &buffer[3001], sizeof(buffer) - 3001, crc);
+    if ((crc != expect) || (memcmp(buffer, plaintext, sizeof(plaintext)) != 0)) {
+        return(-1);
+    }
+    return(0);
+}
+
+/** Check multi-lane HChaCha20 and init against single calls on every
+ * kernel, and the subkey cache against xchacha_init on hits and misses.
+ * @returns 0 on success, -1 on failure or error
+ */
+int check_subkeys(void){
+    xChaCha_ctx ctx[21], one;
+    xchacha_subkey_cache cache;
+    xchacha_key_handle h[2];
+    uint8_t key[32], key2[32], nonces[21 * 24], sub[21 * 32], ref[32];
+    int i, j, id, best = xchacha_kernel();
+
+    for (i = 0; i < 32; i++) key[i] = (uint8_t)(i * 13 + 5);
+    for (i = 0; i < 32; i++) key2[i] = (uint8_t)(i * 13 + 6);
+    for (i = 0; i < (int)sizeof(nonces); i++) nonces[i] = (uint8_t)(i * 17);
+    for (id = XC_KERNEL_SCALAR; id < XC_KERNELS; id++) {
+        if (xchacha_kernel_select(id) != 0) continue;
+        xchacha_hchacha20_multi(sub, nonces, key, 21);
+        xchacha_init_multi(ctx, key, nonces, 21);
+        for (i = 0; i < 21; i++) {
+            xchacha_hchacha20(ref, &nonces[i * 16], key);
+            xchacha_init(&one, key, &nonces[i * 24]);
+            if (memcmp(ref, &sub[i * 32], 32) || memcmp(one.input, ctx[i].input, 64)) {
+                xchacha_kernel_select(best);
+                return(-1);
+            }
+        }
+    }
+    xchacha_kernel_select(best);
+
+    if (xchacha_subkey_cache_init(&cache, 8) != 0) {
+        return(-1);
+    }
+    xchacha_cache_key(&cache, key, &h[0]);
+    xchacha_cache_key(&cache, key2, &h[1]);
+    for (j = 0; j < 3; j++) {                   // 2 keys x 6 nonces, 8 entries
+        for (i = 0; i < 12; i++) {
+            const uint8_t *k = (i & 1) ? key2 : key;
+            xchacha_init_cached(&cache, &h[i & 1], &ctx[0], &nonces[(i >> 1) * 24]);
+            xchacha_init(&one, k, &nonces[(i >> 1) * 24]);
+            if (memcmp(one.input, ctx[0].input, 64) != 0) {
+                xchacha_subkey_cache_free(&cache);
+                return(-1);
+            }
+        }
+    }
+    nonces[20] ^= 1;                            // bytes 16..23 are not cached
+    xchacha_init_cached(&cache, &h[0], &ctx[0], nonces);
+    xchacha_init(&one, key, nonces);
+    if ((cache.hits == 0) || (cache.misses < 12) || (cache.hits + cache.misses != 37)
+     || memcmp(one.input, ctx[0].input, 64)) {
+        xchacha_subkey_cache_free(&cache);
+        return(-1);
+    }
+    xchacha_subkey_cache_free(&cache);
+    return(0);
+}
+
 int main(void){
     if((check_ietf()) == 0
     && (check_cpp()) == 0
-    && (check_second_ietf() == 0)){
+    && (check_second_ietf() == 0)
+    && (check_split() == 0)
+    && (check_kernels() == 0)
+    && (check_seek() == 0)
+    && (check_parallel() == 0)
+    && (check_poly1305() == 0)
+    && (check_aead() == 0)
+    && (check_batch() == 0)
+    && (check_reduced() == 0)
+    && (check_container() == 0)
+    && (check_cipher() == 0)
+    && (check_random() == 0)
+    && (check_stats() == 0)
+    && (check_iov() == 0)
+    && (check_ring() == 0)
+    && (check_siphash() == 0)
+    && (check_session() == 0)
+    && (check_sectors() == 0)
+    && (check_crc32c() == 0)
+    && (check_subkeys() == 0)){
         printf("Cryptographic tests passed\n");
     } else {
         printf("Cryptographic tests failed!\n");